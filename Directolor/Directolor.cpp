@@ -20,7 +20,14 @@
 #include <SPI.h>
 #include "printf.h"
 #include "RF24.h"
-#include "CRC.h"
+#ifdef ESP32
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+#include <sys/time.h>
+#endif
+
+#define DIRECTOLOR_SLEEP_MAGIC 0x44534C50 // "DSLP" - RTC memory holds a queue from before a deep sleep
 
 RF24 Directolor::radio;
 bool Directolor::messageIsSending = false;
@@ -34,7 +41,35 @@ uint16_t Directolor::_cepin;
 uint16_t Directolor::_cspin;
 uint32_t Directolor::_spi_speed;
 
-constexpr uint8_t Directolor::matchPattern[4] = {0xC0, 0X11, 0X00, 0X05}; // this is what we use to find out what the codes for the remote are
+DirectolorRemoteMatcher Directolor::remoteMatcher; // this is what we use to find out what the codes for the remote are
+constexpr Directolor::RemoteCode Directolor::remoteCodes[];
+constexpr uint8_t Directolor::searchChannels[] = {DIRECTOLOR_SEARCH_CHANNELS};
+constexpr uint8_t Directolor::searchAddressWidths[] = {DIRECTOLOR_SEARCH_ADDRESS_WIDTHS};
+uint8_t Directolor::searchStep = 0;
+uint8_t Directolor::searchStepCount = 0;
+unsigned long Directolor::searchStepMillis = 0;
+unsigned long Directolor::searchStartMillis = 0;
+uint32_t Directolor::searchPayloadCount = 0;
+Print *Directolor::captureLog = 0;
+Directolor::EventSubscriber Directolor::eventSubscribers[DIRECTOLOR_MAX_EVENT_SUBSCRIBERS];
+DirectolorTransmitGate Directolor::transmitGate = 0;
+void *Directolor::transmitGateContext = 0;
+uint16_t Directolor::burstMillis = 180; // until one has been measured
+DirectolorRadioStats Directolor::radioHealth = {false, 0, 0, 0, 0, 0, 0, 0, DIRECTOLOR_RADIO_RETRY_MIN_MS};
+unsigned long Directolor::lastRadioAttempt = 0;
+unsigned long Directolor::lastRadioProbe = 0;
+bool Directolor::lowPower = false;
+DirectolorPowerStats Directolor::power;
+unsigned long Directolor::awakeSince = 0;
+bool Directolor::listening = false;
+unsigned long Directolor::listeningSince = 0;
+unsigned long Directolor::wakeMicros = 0;
+bool Directolor::wakePending = false;
+#ifdef ESP32
+RTC_DATA_ATTR Directolor::SleepState Directolor::sleepState; // survives deep sleep (cleared on power up)
+#else
+Directolor::SleepState Directolor::sleepState;
+#endif
 
 Directolor::Directolor(uint16_t cepin, uint16_t cspin, uint32_t spi_speed)
 {
@@ -43,7 +78,7 @@ Directolor::Directolor(uint16_t cepin, uint16_t cspin, uint32_t spi_speed)
   _spi_speed = spi_speed;
   for (int i = 0; i < DIRECTOLOR_MAX_QUEUED_COMMANDS; i++)
   {
-    commandItems[i].radioCodes = 0;
+    commandItems[i].remote = 0;
     commandItems[i].blindAction = directolor_stop;
     commandItems[i].channels = 0;
   }
@@ -51,11 +86,18 @@ Directolor::Directolor(uint16_t cepin, uint16_t cspin, uint32_t spi_speed)
 
 /**
  * Sets the protocol to send.
+ *
+ * Called from everywhere the radio is about to be used, so while it's down this only tries again (and only logs) every
+ * radioHealth.retryMillis - DIRECTOLOR_RADIO_RETRY_MIN_MS for the first retry, doubled after each retry that fails.
  */
 bool Directolor::radioStarted()
 {
   if (!radioValid)
   {
+    if (radioHealth.startAttempts && millis() - lastRadioAttempt < radioHealth.retryMillis)
+      return false;
+    bool retry = radioHealth.startAttempts != 0; // the very first attempt hasn't waited out retryMillis - every other one has (after a fault too)
+
     if (!radioInitialized)
     {
       Serial.print("Attempting to initialize radio - CE Pin:");
@@ -65,54 +107,144 @@ bool Directolor::radioStarted()
       radio = RF24(_cepin, _cspin, _spi_speed);
       radioInitialized = true;
     }
-    Serial.println("Attempting to start radio");
-    radioValid = radio.begin();
-    if (radioValid)
+    if (startRadio())
     {
-      radio.setAutoAck(false);               // auto-ack has to be off or everything breaks because I haven't been able to RE the protocol CRC / validation
-      radio.setCRCLength(RF24_CRC_DISABLED); // disable CRC
-
-      radio.setChannel(53); // remotes transmit at 2453 mHz
-
-      radio.closeReadingPipe(0); // close pipes in case something left it listening
-      radio.closeReadingPipe(1);
-      radio.closeReadingPipe(2);
-      radio.closeReadingPipe(3);
-      radio.closeReadingPipe(4);
-      radio.closeReadingPipe(5);
       Serial.println("Radio started");
+      if (radioHealth.faults) // back from a fault - pick up where it left off
+      {
+        if (lowPower && !learningRemote)
+          radioPowerDown();
+        else
+          enterRemoteCaptureMode();
+      }
     }
-    else
+    else if (!retry || (radioHealth.faults && radioHealth.retryMillis == DIRECTOLOR_RADIO_RETRY_MIN_MS)) // first failure of this outage
     {
-      Serial.println("Failure starting radio");
+      Serial.println("Failure starting radio - retrying with backoff");
     }
+    if (!radioValid && retry)
+      radioHealth.retryMillis = radioHealth.retryMillis < DIRECTOLOR_RADIO_RETRY_MAX_MS / 2 ? radioHealth.retryMillis * 2 : DIRECTOLOR_RADIO_RETRY_MAX_MS;
+  }
+  return radioValid;
+}
+
+bool Directolor::startRadio()
+{
+  lastRadioAttempt = millis();
+  lastRadioProbe = lastRadioAttempt;
+  radioHealth.startAttempts++;
+  radioValid = radio.begin() && radio.isChipConnected();
+  if (radioValid)
+  {
+    configureRadio();
+    radioHealth.retryMillis = DIRECTOLOR_RADIO_RETRY_MIN_MS;
+    setRadioUp(true);
+  }
+  else
+  {
+    radioHealth.startFailures++;
+    if (radioHealth.startAttempts == 1) // it's never been up, so there's no change to publish - say so once anyway
+      publishEvent(directolor_eventRadioDown, 0, 0, directolor_stop, 0);
   }
   return radioValid;
 }
 
+bool Directolor::radioHealthy() // a few register reads - cheap enough for after every burst
+{
+  lastRadioProbe = millis();
+  return radio.isChipConnected() && radio.getCRCLength() == RF24_CRC_DISABLED; // a brown out resets the nRF24, and CRC (with auto-ack) back on is the giveaway
+}
+
+void Directolor::radioFault(const char *reason)
+{
+  Serial.print("Radio fault - ");
+  Serial.println(reason);
+  radioHealth.faults++;
+  radioValid = false;
+  radioListening(false);
+  lastRadioAttempt = millis(); // first retry after DIRECTOLOR_RADIO_RETRY_MIN_MS
+  radioHealth.retryMillis = DIRECTOLOR_RADIO_RETRY_MIN_MS;
+  setRadioUp(false);
+}
+
+void Directolor::setRadioUp(bool up)
+{
+  if (up == radioHealth.up)
+    return;
+  if (radioHealth.up)
+    radioHealth.upMillis += millis() - radioHealth.sinceMillis;
+  else
+    radioHealth.downMillis += millis() - radioHealth.sinceMillis;
+  radioHealth.up = up;
+  radioHealth.sinceMillis = millis();
+  publishEvent(up ? directolor_eventRadioUp : directolor_eventRadioDown, 0, 0, directolor_stop, 0);
+}
+
+DirectolorRadioStats Directolor::radioStats()
+{
+  DirectolorRadioStats stats = radioHealth;
+  if (stats.up)
+    stats.upMillis += millis() - stats.sinceMillis;
+  else
+    stats.downMillis += millis() - stats.sinceMillis;
+  return stats;
+}
+
+void Directolor::configureRadio()
+{
+  radio.setAutoAck(false);               // auto-ack has to be off or everything breaks because I haven't been able to RE the protocol CRC / validation
+  radio.setCRCLength(RF24_CRC_DISABLED); // disable CRC
+
+  radio.setChannel(DIRECTOLOR_RADIO_CHANNEL);
+
+  radio.closeReadingPipe(0); // close pipes in case something left it listening
+  radio.closeReadingPipe(1);
+  radio.closeReadingPipe(2);
+  radio.closeReadingPipe(3);
+  radio.closeReadingPipe(4);
+  radio.closeReadingPipe(5);
+}
+
 bool Directolor::enterRemoteSearchMode()
 {
   if (radioStarted())
   {
-    radio.stopListening();
-    radio.setAddressWidth(5);
-    radio.openReadingPipe(1, 0x5555555555); // always uses pipe 0
     Serial.println(F("searching for remote"));
-    radio.startListening(); // put radio in RX mode
     learningRemote = true;
-    radio.setPayloadSize(MAX_PAYLOAD_SIZE);
-    // this->radio.printPrettyDetails(); // (larger) function that prints human readable data - only used for debugging
+    searchStep = 0;
+    searchPayloadCount = 0;
+    searchStartMillis = millis();
     memset(&remoteCode, 0, sizeof(remoteCode));
+    configureRemoteSearch();
     return true;
   }
   return false;
 }
 
+void Directolor::configureRemoteSearch() // listen for 0x55 preamble using the current step of the channel / address width search plan
+{
+  uint8_t channel = searchChannels[searchStep % sizeof(searchChannels)];
+  uint8_t addressWidth = searchAddressWidths[(searchStep / sizeof(searchChannels)) % sizeof(searchAddressWidths)];
+
+  radio.stopListening();
+  radio.setChannel(channel);
+  radio.setAddressWidth(addressWidth);
+  radio.openReadingPipe(1, 0x5555555555); // only the low addressWidth bytes are used
+  radio.setPayloadSize(MAX_PAYLOAD_SIZE);
+  radio.startListening(); // put radio in RX mode
+  radioListening(true);
+  // this->radio.printPrettyDetails(); // (larger) function that prints human readable data - only used for debugging
+  remoteMatcher.reset(); // bytes from different channels / address widths aren't one stream
+  searchStepMillis = millis();
+  searchStepCount++;
+}
+
 void Directolor::enterRemoteCaptureMode()
 {
   if (remoteCode.radioCode[0] || remoteCode.radioCode[1])
   {
     radio.stopListening();
+    radio.setChannel(DIRECTOLOR_RADIO_CHANNEL);
     radio.setAddressWidth(3);
 
     union
@@ -129,18 +261,34 @@ void Directolor::enterRemoteCaptureMode()
     radio.openReadingPipe(0, 0xFFFFC0);
 
     radio.startListening(); // put radio in RX mode
+    radioListening(true);
     Serial.println(F("Capture Mode"));
   }
   else if (learningRemote)
   {
-    enterRemoteSearchMode();
+    configureRemoteSearch();
   }
   else
   {
-    radio.powerDown();
+    radioPowerDown();
   }
 }
 
+void Directolor::radioListening(bool nowListening)
+{
+  if (nowListening && !listening)
+    listeningSince = millis();
+  else if (!nowListening && listening)
+    power.radioListenMillis += millis() - listeningSince;
+  listening = nowListening;
+}
+
+void Directolor::radioPowerDown()
+{
+  radio.powerDown();
+  radioListening(false);
+}
+
 void Directolor::printData(char payload[], int start, int count, char *separator)
 {
   for (int i = start; i < count + start; i++)
@@ -167,10 +315,17 @@ void Directolor::dumpCodes()
   Serial.println("}}");
 }
 
-void Directolor::checkRadioPayload() // could modify this to allow capture if commands were sent using multiple channels
+void Directolor::checkRadioPayload()
 {
   if (radioStarted())
   {
+    if (learningRemote && (millis() - searchStepMillis) > DIRECTOLOR_SEARCH_DWELL_MS && sizeof(searchChannels) * sizeof(searchAddressWidths) > 1)
+    {
+      if (++searchStep == sizeof(searchChannels) * sizeof(searchAddressWidths))
+        searchStep = 0;
+      configureRemoteSearch();
+    }
+
     uint8_t pipe;
     if (radio.available(&pipe))
     {
@@ -178,30 +333,44 @@ void Directolor::checkRadioPayload() // could modify this to allow capture if co
       uint8_t bytes = radio.getPayloadSize(); // get the size of the payload
       radio.read(&payload, bytes);            // fetch payload from FIFO
 
+      if (captureLog)
+      {
+        DirectolorCaptureRecord record;
+        record.sync = DIRECTOLOR_CAPTURE_SYNC;
+        record.flags = (radio.getChannel() & DIRECTOLOR_CAPTURE_CHANNEL_MASK) | (learningRemote ? DIRECTOLOR_CAPTURE_SEARCH_MODE : 0);
+        record.pipe = (pipe & DIRECTOLOR_CAPTURE_PIPE_MASK) | (learningRemote ? searchStepCount << DIRECTOLOR_CAPTURE_STEP_SHIFT : 0);
+        record.length = bytes;
+        record.timestamp = millis();
+        memcpy(record.payload, payload, sizeof(record.payload));
+        captureLog->write((uint8_t *)&record, sizeof(record));
+      }
+
       if (learningRemote)
       {
         Serial.print(".");
-        uint8_t foundPattern = 0;
+        searchPayloadCount++;
 
-        for (int i = 0; i < bytes; i++)
+        if (remoteMatcher.feed((uint8_t *)payload, bytes))
         {
-          if (payload[i] != matchPattern[foundPattern])
-            foundPattern = 0;
-          else
-            foundPattern++;
-
-          if (foundPattern > 3 && i > 4)
-          {
-            Serial.println();
-            Serial.print(F("Found Remote with address: "));
-            printData(payload, i - 5, 3);
-            Serial.println();
-
-            remoteCode.radioCode[0] = payload[i - 5];
-            remoteCode.radioCode[1] = payload[i - 4];
-            learningRemote = false;
-            enterRemoteCaptureMode();
-          }
+          remoteCode.radioCode[0] = remoteMatcher.radioCode(0);
+          remoteCode.radioCode[1] = remoteMatcher.radioCode(1);
+
+          Serial.println();
+          Serial.print(F("Found Remote with address: "));
+          printData((char *)remoteCode.radioCode, 0, 2);
+          Serial.print(F(" C0 ("));
+          Serial.print(remoteMatcher.channelCount());
+          Serial.print(F(" channel(s)) after "));
+          Serial.print(searchPayloadCount);
+          Serial.print(F(" payloads / "));
+          Serial.print(millis() - searchStartMillis);
+          Serial.print(F("ms on channel "));
+          Serial.print(searchChannels[searchStep % sizeof(searchChannels)]);
+          Serial.print(F(" address width "));
+          Serial.println(searchAddressWidths[(searchStep / sizeof(searchChannels)) % sizeof(searchAddressWidths)]);
+
+          learningRemote = false;
+          enterRemoteCaptureMode();
         }
       }
       else
@@ -225,14 +394,26 @@ void Directolor::checkRadioPayload() // could modify this to allow capture if co
 
         Serial.print(" ");
 
-        switch (payload[0])
-        {
-          uint8_t *commandGroup;
-        case COMMAND_CODE_LENGTH:
-          remoteCode.radioCode[2] = payload[6];
-          remoteCode.radioCode[3] = payload[7];
+        DirectolorFrame frame;
+        directolorDecodeFrame((uint8_t *)payload, MAX_PAYLOAD_SIZE, frame);
 
-          switch ((BlindAction)payload[16])
+        switch (frame.type)
+        {
+        case directolor_frameCommand:
+          remoteCode.radioCode[2] = frame.radioCode[0];
+          remoteCode.radioCode[3] = frame.radioCode[1];
+          publishEvent(directolor_eventRemoteOverheard, remoteIdFor(remoteCode.radioCode), frame.channels, (BlindAction)frame.action, 0, remoteCode.radioCode);
+
+          Serial.print("Channels:");
+          for (int i = 0; i < DIRECTOLOR_REMOTE_CHANNELS; i++)
+            if (bitRead(frame.channels, i))
+            {
+              Serial.print(" ");
+              Serial.print(i + 1);
+            }
+          Serial.print(" - ");
+
+          switch ((BlindAction)frame.action)
           {
           case directolor_open:
             Serial.print("Open");
@@ -254,8 +435,8 @@ void Directolor::checkRadioPayload() // could modify this to allow capture if co
             break;
           };
           break;
-        case GROUP_CODE_LENGTH:
-          switch ((BlindAction)payload[10])
+        case directolor_frameGroup:
+          switch ((BlindAction)frame.action)
           {
           case directolor_join:
             Serial.print("Join");
@@ -265,10 +446,10 @@ void Directolor::checkRadioPayload() // could modify this to allow capture if co
             break;
           }
           break;
-        case STORE_FAV_CODE_LENGTH:
+        case directolor_frameStoreFav:
           Serial.print("Store Favorite");
           break;
-        case DUPLICATE_CODE_LENGTH:
+        case directolor_frameDuplicate:
           Serial.print("Duplicate");
           break;
         };
@@ -290,10 +471,7 @@ bool Directolor::sendMultiChannelCode(int remoteId, uint8_t channels, BlindActio
   if (channels > pow(2, DIRECTOLOR_REMOTE_CHANNELS) || remoteId < 1 || remoteId > DIRECTOLOR_REMOTE_COUNT)
     return false;
 
-  if (!radioStarted())
-    return false;
-
-  uint8_t *uniqueBytes;
+  radioStarted(); // nudge it - the command is queued either way, and goes once the radio is up
 
   Serial.print("Remote ");
   Serial.print(remoteId);
@@ -326,6 +504,9 @@ bool Directolor::sendMultiChannelCode(int remoteId, uint8_t channels, BlindActio
   case directolor_toFav:
     Serial.println("to Fav");
     break;
+  case directolor_setFav:
+    Serial.println("Set Fav");
+    break;
   case directolor_join:
     sendCode(remoteId, channels, directolor_duplicate);
     Serial.println("JOIN");
@@ -338,44 +519,11 @@ bool Directolor::sendMultiChannelCode(int remoteId, uint8_t channels, BlindActio
     Serial.println("DUPLICATE");
   }
 
-  bool commandQueued = false;
-  uint8_t *radioCodes = (uint8_t *)remoteCodes[remoteId - 1].radioCode;
-  for (int i = 0; i < DIRECTOLOR_MAX_QUEUED_COMMANDS; i++)
-  {
-    if (commandItems[i].radioCodes != radioCodes)
-    {
-      continue;
-    }
-    else if (commandItems[i].blindAction == blindAction) // same action - update channels - reset attempts
-    {
-      commandItems[i].channels |= channels;
-      commandItems[i].resendRemainingCount = MESSAGE_SEND_ATTEMPTS;
-      commandQueued = true;
-      break;
-    }
-    else if (commandItems[i].channels | channels && blindAction != directolor_join && blindAction != directolor_remove) // different action - make sure we remove and disable action if required
-    {
-      commandItems[i].channels ^= channels;
-      if (!commandItems[i].channels)
-        commandItems[i].radioCodes = 0;
-      break;
-    }
-  }
+  CommandItem *queued = directolorEnqueue(commandItems, DIRECTOLOR_MAX_QUEUED_COMMANDS, remoteId, channels, blindAction, MESSAGE_SEND_ATTEMPTS, onSuperseded);
+  if (!queued)
+    return false; // queue is full
 
-  if (!commandQueued)
-  {
-    for (int i = 0; i < DIRECTOLOR_MAX_QUEUED_COMMANDS; i++)
-    {
-      if (commandItems[i].radioCodes == 0)
-      {
-        commandItems[i].radioCodes = radioCodes;
-        commandItems[i].channels = channels;
-        commandItems[i].blindAction = blindAction;
-        commandItems[i].resendRemainingCount = MESSAGE_SEND_ATTEMPTS;
-        break;
-      }
-    }
-  }
+  publishEvent(directolor_eventEnqueued, remoteId, queued->channels, blindAction, MESSAGE_SEND_ATTEMPTS);
   return true;
 }
 
@@ -396,194 +544,36 @@ bool Directolor::sendCode(byte *payload, uint8_t payload_size)
 
   for (int i = 0; i < MESSAGE_SEND_RETRIES; i++) // setting this too low failed intermittently
   {
-    radio.writeFast(payload, payload_size, true); // we aren't waiting for an ACK, so we need to writeFast with multiCast set to true
-    radio.txStandBy();
+    if (!radio.writeFast(payload, payload_size, true) || !radio.txStandBy()) // we aren't waiting for an ACK, so we need to writeFast with multiCast set to true
+    {
+      radio.flush_tx(); // the TX FIFO didn't drain (RF24 gives up after 95ms) - don't sit through the rest of the burst
+      return false;
+    }
     // delayMicroseconds(1); // removing this made it not work
   }
   return true;
 }
 
-// There are a lot of hardcoded values here.  I'm unsure why these ever might need to be different.
-// Here are codes I gathered from my remotes
-// remote 1
-// 12 80 0D 55 FF FF C4 05 B1 EC 1D E3 98 8B C7 52 75 A9 C8 B1 DA
-// 12 80 0D 06 FF FF C4 05 B1 EC 1D E3 98 8B C7 52 75 A9 C8 A4 B1
-// 12 80 0D 02 FF FF C4 05 B1 EC 1D E3 98 8B C7 52 75 A9 C8 68 B3
-
-// remote 2
-// 12 80 0D 85 FF FF BD 55 08 4F 65 60 B0 B0 77 FA 2D FD C8 E2 2E
-// 12 80 0D FF FF FF BD 55 08 4F 65 60 B0 B0 77 FA 2D FD C8 B9 26
-
-// They always send the same value, per remote, and I think it might be some sort of MAC address or something.  Anyway, doesn't appear to need to be different and the generated duplicate codes from these random values seem to work just fine....
-
-static constexpr uint8_t duplicatePrototype[] = {0XFF, 0XFF, 0xC0, 0X12, 0X80, 0X0D, 0x67, 0XFF, 0XFF, 0XC4, 0X05, 0XB1, 0XEC, 0X1D, 0XE3, 0X98, 0x8B, 0X2D, 0XDE, 0X00, 0XEF, 0XC8}; // 6, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 22, 23
-
-int Directolor::getDuplicateRadioCommand(byte *payload, CommandItem commandItem)
+void Directolor::onSuperseded(const CommandItem &commandItem, uint8_t channels, void *context)
 {
-  const uint8_t offset = 0;
-  int payloadOffset = 0;
-  // int uniqueBytesOffset = i * DUPLICATE_CODE_UNIQUE_BYTES;
-  for (int j = 0; j < sizeof(duplicatePrototype); j++)
-  {
-    switch (j) // 6, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 22, 23
-    {
-    case 6 + offset:
-      payload[payloadOffset + j] = random(256);
-      break;
-    case 9 + offset:
-      payload[payloadOffset + j] = 0x06;
-      break;
-    case 10 + offset:
-      payload[payloadOffset + j] = 0x03;
-      break;
-    case 11 + offset:
-      payload[payloadOffset + j] = 0x20;
-      break;
-    case 12 + offset:
-      payload[payloadOffset + j] = 0x05;
-      break;
-    case 13 + offset:
-      payload[payloadOffset + j] = 0x12;
-      break;
-    case 14 + offset:
-      payload[payloadOffset + j] = 0x03;
-      break;
-    case 15 + offset:
-      payload[payloadOffset + j] = 0xAC;
-      break;
-    case 16 + offset:
-      payload[payloadOffset + j] = 0x56;
-      break;
-    case 17 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[1];
-      break;
-    case 18 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[0];
-      break;
-    case 19 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[2];
-      break;
-    case 20 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[3];
-      break;
-    default:
-      payload[payloadOffset + j] = duplicatePrototype[j];
-      break;
-    }
-  }
-  return sizeof(duplicatePrototype);
+  publishEvent(directolor_eventSuperseded, commandItem.remote, channels, (BlindAction)commandItem.blindAction, commandItem.resendRemainingCount);
 }
 
-static constexpr uint8_t groupPrototype[] = {0X11, 0X11, 0xC0, 0X0A, 0X40, 0X05, 0X18, 0XFF, 0XFF, 0X8A, 0X91, 0X08, 0X03, 0X01}; // 0, 1, 6, 9, 10, 12, 13, 14, 15
-
-int Directolor::getGroupRadioCommand(byte *payload, CommandItem commandItem)
-{
-  const uint8_t offset = 0;
-  int payloadOffset = 0;
-  for (int j = 0; j < sizeof(groupPrototype); j++)
-  {
-    switch (j) // 0, 1, 6, 9, 10, 12, 13, 14, 15
-    {
-    case 0 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[0];
-      break;
-    case 1 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[1];
-      break;
-    case 6 + offset:
-      payload[payloadOffset + j] = random(256);
-      break;
-    case 9 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[2];
-      break;
-    case 10 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[3];
-      break;
-    case 12 + offset:
-      for (int i = 5; i >= 0; i--)
-      {
-        if (bitRead(commandItem.channels, i))
-        {
-          payload[payloadOffset + j] = i + 1;
-        }
-      }
-      break;
-    case 13 + offset:
-      payload[payloadOffset + j] = commandItem.blindAction;
-      break;
-    default:
-      payload[payloadOffset + j] = groupPrototype[j];
-      break;
-    }
-  }
-  return sizeof(groupPrototype);
-}
-
-static constexpr uint8_t commandPrototype[] = {0X11, 0X11, 0xC0, 0X10, 0X00, 0X05, 0XBC, 0XFF, 0XFF, 0X8A, 0X91, 0X86, 0X06, 0X99, 0X01, 0X00, 0X8A, 0X91, 0X52, 0X53, 0X00};
-
 int Directolor::getRadioCommand(byte *payload, CommandItem commandItem)
 {
+  uint16_t nonce = random(256) << 8 | random(256);
+  const uint8_t *radioCode = remoteCodes[commandItem.remote - 1].radioCode;
   switch (commandItem.blindAction)
   {
   case directolor_join:
   case directolor_remove:
-    return getGroupRadioCommand(payload, commandItem);
+    return directolorBuildGroupFrame(payload, radioCode, commandItem.channels, commandItem.blindAction, nonce);
   case directolor_duplicate:
-    return getDuplicateRadioCommand(payload, commandItem);
-  }
-  const uint8_t offset = 0;
-  int payloadOffset = 0;
-  int j = 0;
-  while (j + payloadOffset < MAX_PAYLOAD_SIZE)
-  {
-    switch (j) // 0, 1, 6, 9, 10, 12, 13, 14, 15
-    {
-    case 0 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[0];
-      break;
-    case 1 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[1];
-      break;
-    case 6 + offset:
-      payload[payloadOffset + j] = random(256);
-      break;
-    case 9 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[2];
-      break;
-    case 10 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[3];
-      break;
-    case 13 + offset:
-      payload[payloadOffset + j] = random(256);
-      break;
-    case 14 + offset:
-      for (int i = 0; i < DIRECTOLOR_REMOTE_CHANNELS; i++)
-      {
-        if (bitRead(commandItem.channels, i))
-        {
-          payload[j + payloadOffset++] = i + 1;
-          payload[3]++;
-        }
-      }
-      payloadOffset--;
-      break;
-    case 16 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[2];
-      break;
-    case 17 + offset:
-      payload[payloadOffset + j] = commandItem.radioCodes[3];
-      break;
-    case 19 + offset:
-      payload[payloadOffset + j] = commandItem.blindAction;
-      break;
-    default:
-      payload[payloadOffset + j] = commandPrototype[j];
-      break;
-    }
-    j++;
+    return directolorBuildDuplicateFrame(payload, radioCode, nonce);
+  case directolor_setFav:
+    return directolorBuildStoreFavFrame(payload, radioCode, nonce);
   }
-
-  return sizeof(commandPrototype) + payloadOffset;
+  return directolorBuildCommandFrame(payload, radioCode, commandItem.channels, commandItem.blindAction, nonce);
 }
 
 unsigned long lastMessageSend = 0;
@@ -594,13 +584,26 @@ void Directolor::processLoop()
 {
   if (++lastCommand == DIRECTOLOR_MAX_QUEUED_COMMANDS)
     lastCommand = 0;
-  if (((millis() - lastMessageSend) > INTERMESSAGE_SEND_DELAY) && ((millis() - lastInhibit) > lastInhibitDuration) && (commandItems[lastCommand].radioCodes != 0))
+  if (((millis() - lastMessageSend) > INTERMESSAGE_SEND_DELAY) && ((millis() - lastInhibit) > lastInhibitDuration) && (commandItems[lastCommand].remote != 0) && radioStarted() &&
+      (!transmitGate || transmitGate(DIRECTOLOR_POWER_UP_DELAY_MS + burstMillis * (commandItems[lastCommand].blindAction == directolor_setFav ? 2 : 1), transmitGateContext)))
   {
     messageIsSending = true;
+    unsigned long txStart = millis();
+    if (wakePending) // first burst since sleep() / resume()
+    {
+      uint32_t latency = micros() - wakeMicros;
+      wakePending = false;
+      power.wakes++;
+      power.wakeLatencyMicros = latency;
+      power.wakeLatencyTotalMicros += latency;
+      if (latency > power.wakeLatencyMaxMicros)
+        power.wakeLatencyMaxMicros = latency;
+    }
     radio.powerUp();
     radio.stopListening(); // put radio in TX mode
+    radioListening(false);
 
-    delay(20); // the first command seems to be weak...
+    delay(DIRECTOLOR_POWER_UP_DELAY_MS); // the first command seems to be weak...
     radio.setPALevel(RF24_PA_MAX);
     radio.setAddressWidth(3);
     radio.enableDynamicAck();
@@ -609,36 +612,58 @@ void Directolor::processLoop()
     unsigned long start_timer = millis();
 
     byte payload[MAX_PAYLOAD_SIZE];
+    bool burstSent = true;
 
-    int length = getRadioCommand(payload, commandItems[lastCommand]);
-
-    uint16_t crc = crc16((uint8_t *)payload, length, 0x755b, 0xFFFF, 0, false, false); // took some time to figure this out.  big thanks to CRC RevEng by Gregory Cook!!!!  CRC is calculated over the whole payload, including radio id at start.
-    payload[length++] = crc >> 8;
-    payload[length] = crc & 0xFF;
-
-    for (int i = MAX_PAYLOAD_SIZE; i > 0; i--) // pad with leading 0x55 to train the shade receivers
+    if (commandItems[lastCommand].blindAction == directolor_setFav) // the store favorite frame has no channels - the shades that just got this stop are the ones that store
     {
-      if (i - (MAX_PAYLOAD_SIZE - length) >= 0)
-        payload[i - 1] = payload[i - (MAX_PAYLOAD_SIZE - length)];
-      else
-        payload[i - 1] = 0x55;
+      CommandItem stopItem = commandItems[lastCommand];
+      stopItem.blindAction = directolor_stop;
+      directolorFinishFrame(payload, getRadioCommand(payload, stopItem));
+      burstSent = sendCode(payload, MAX_PAYLOAD_SIZE);
     }
 
-    sendCode(payload, MAX_PAYLOAD_SIZE);
+    if (burstSent)
+    {
+      int length = getRadioCommand(payload, commandItems[lastCommand]);
+      directolorFinishFrame(payload, length); // CRC + leading 0x55 padding
+
+      burstSent = sendCode(payload, MAX_PAYLOAD_SIZE);
+    }
 
     unsigned long end_timer = millis();
-    Serial.println(end_timer - start_timer);
+    power.radioTxMillis += end_timer - txStart;
     lastMessageSend = millis();
+    if (!burstSent || !radioHealthy()) // the command keeps its attempts and goes again once the radio is back
+    {
+      radioHealth.failedBursts++;
+      radioFault(burstSent ? "registers reset" : "TX FIFO stuck");
+      messageIsSending = false;
+      return;
+    }
+    Serial.println(end_timer - start_timer);
+    burstMillis = (end_timer - start_timer) / (commandItems[lastCommand].blindAction == directolor_setFav ? 2 : 1);
     if (commandItems[lastCommand].blindAction == directolor_duplicate) // join / remove require duplicate to immediately preceed.
       lastMessageSend = 0;
+    CommandItem sent = commandItems[lastCommand];
     if (--commandItems[lastCommand].resendRemainingCount == 0)
-      commandItems[lastCommand].radioCodes = 0;
+      commandItems[lastCommand].remote = 0;
+
+    publishEvent(directolor_eventTransmitted, sent.remote, sent.channels, (BlindAction)sent.blindAction, sent.resendRemainingCount - 1);
+    if (sent.resendRemainingCount == 1)
+      publishEvent(directolor_eventCompleted, sent.remote, sent.channels, (BlindAction)sent.blindAction, 0);
   }
 
   if (messageIsSending)
   {
     messageIsSending = false;
-    enterRemoteCaptureMode();
+    if (lowPower && !learningRemote)
+      radioPowerDown();
+    else
+      enterRemoteCaptureMode();
+  }
+  else if (radioValid && millis() - lastRadioProbe >= DIRECTOLOR_RADIO_PROBE_MS && !radioHealthy())
+  {
+    radioFault("not answering");
   }
   checkRadioPayload();
 }
@@ -660,6 +685,237 @@ void Directolor::inhibitSend(int durationMS)
   }
 }
 
+void Directolor::setLowPower(bool enabled)
+{
+  lowPower = enabled;
+  if (radioValid && !messageIsSending)
+  {
+    if (lowPower && !learningRemote)
+      radioPowerDown();
+    else if (!lowPower)
+      enterRemoteCaptureMode();
+  }
+}
+
+unsigned long Directolor::idleMillis()
+{
+  if (learningRemote)
+    return 0;
+  if (!queuedCommandCount())
+    return DIRECTOLOR_IDLE_FOREVER;
+
+  unsigned long sinceSend = millis() - lastMessageSend;
+  unsigned long sinceInhibit = millis() - lastInhibit;
+  unsigned long sendWait = sinceSend > (INTERMESSAGE_SEND_DELAY) ? 0 : (INTERMESSAGE_SEND_DELAY) + 1 - sinceSend; // processLoop() wants strictly more than the delay
+  unsigned long inhibitWait = sinceInhibit > (unsigned long)lastInhibitDuration ? 0 : lastInhibitDuration + 1 - sinceInhibit;
+  unsigned long wait = sendWait > inhibitWait ? sendWait : inhibitWait;
+  if (!radioValid && radioHealth.startAttempts) // nothing goes out until radioStarted() tries again - with the radio gone for a while that's up to DIRECTOLOR_RADIO_RETRY_MAX_MS, long enough to deep sleep through
+  {
+    unsigned long sinceAttempt = millis() - lastRadioAttempt;
+    unsigned long radioWait = sinceAttempt >= radioHealth.retryMillis ? 0 : radioHealth.retryMillis - sinceAttempt;
+    if (radioWait > wait)
+      wait = radioWait;
+  }
+  return wait;
+}
+
+#ifdef ESP32
+bool Directolor::sleep(unsigned long maxMillis, int wakePin, bool deep)
+{
+  unsigned long duration = idleMillis();
+  if (maxMillis < duration)
+    duration = maxMillis;
+  if (duration < (deep ? DIRECTOLOR_MIN_DEEP_SLEEP_MS : DIRECTOLOR_MIN_LIGHT_SLEEP_MS))
+    return false;
+  if (duration == DIRECTOLOR_IDLE_FOREVER && wakePin < 0) // no timer and no button - nothing would ever wake it
+    return false;
+
+  wakePending = false; // nothing was sent since the last wake, so there's no latency to measure
+  if (radioValid)
+    radioPowerDown();
+  if (duration != DIRECTOLOR_IDLE_FOREVER)
+    esp_sleep_enable_timer_wakeup(duration * 1000ULL);
+  power.sleeps++;
+  power.awakeMillis += millis() - awakeSince;
+  Serial.flush(); // the UART stops while asleep
+
+  if (deep)
+  {
+    if (wakePin >= 0)
+    {
+      rtc_gpio_pullup_en((gpio_num_t)wakePin);
+      rtc_gpio_pulldown_dis((gpio_num_t)wakePin);
+      esp_sleep_enable_ext0_wakeup((gpio_num_t)wakePin, 0);
+    }
+    memcpy(sleepState.commands, commandItems, sizeof(commandItems));
+    sleepState.lastCommand = lastCommand;
+    sleepState.remoteCode = remoteCode;
+    sleepState.burstMillis = burstMillis;
+    sleepState.lowPower = lowPower;
+    sleepState.power = power;
+    sleepState.radio = radioStats();
+    struct timeval now;
+    gettimeofday(&now, 0);
+    sleepState.sleptAtMicros = (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+    sleepState.magic = DIRECTOLOR_SLEEP_MAGIC;
+    esp_deep_sleep_start(); // doesn't return - resume() picks up from here
+  }
+
+  if (wakePin >= 0)
+  {
+    gpio_wakeup_enable((gpio_num_t)wakePin, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+  }
+  unsigned long asleep = millis();
+  esp_light_sleep_start();
+  awakeSince = millis();
+  wakeMicros = micros();
+  wakePending = true;
+  power.lightSleepMillis += awakeSince - asleep;
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+  if (wakePin >= 0)
+    gpio_wakeup_disable((gpio_num_t)wakePin);
+
+  if (radioValid && !lowPower)
+    enterRemoteCaptureMode(); // back to listening, as it was
+  return true;
+}
+#endif
+
+bool Directolor::resume()
+{
+#ifdef ESP32
+  if (sleepState.magic != DIRECTOLOR_SLEEP_MAGIC || esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED) // a reset rather than a wake - RTC memory may still hold an old queue
+  {
+    sleepState.magic = 0;
+    return false;
+  }
+  sleepState.magic = 0;
+  wakeMicros = 0; // micros() starts with the app, so the latency includes the boot after the ROM loader
+  wakePending = true;
+
+  memcpy(commandItems, sleepState.commands, sizeof(commandItems));
+  for (int i = 0; i < DIRECTOLOR_MAX_QUEUED_COMMANDS; i++)
+    if (commandItems[i].remote > DIRECTOLOR_REMOTE_COUNT) // the remote list changed since - drop it rather than send to the wrong shade
+      commandItems[i].remote = 0;
+  lastCommand = sleepState.lastCommand;
+  remoteCode = sleepState.remoteCode;
+  burstMillis = sleepState.burstMillis;
+  lowPower = sleepState.lowPower;
+  power = sleepState.power;
+  struct timeval now;
+  gettimeofday(&now, 0);
+  uint32_t sleptMillis = ((int64_t)now.tv_sec * 1000000 + now.tv_usec - sleepState.sleptAtMicros) / 1000;
+  power.deepSleepMillis += sleptMillis;
+  awakeSince = 0; // the reboot counts as awake
+  lastMessageSend = millis() - (INTERMESSAGE_SEND_DELAY) - 1; // the sleep was at least the gap between bursts, so don't wait it out again
+  lastInhibitDuration = 0;
+  radioHealth = sleepState.radio; // millis() started over with the reboot - the sleep goes on the current stretch
+  radioHealth.sinceMillis = 0;
+  if (radioHealth.up)
+    radioHealth.upMillis += sleptMillis;
+  else
+    radioHealth.downMillis += sleptMillis;
+
+  if (!radioHealth.up) // it slept through a radio backoff (see idleMillis()) - the wait is over, so radioStarted() tries again on the first processLoop() and keeps backing off if the radio is still missing
+  {
+    lastRadioAttempt = millis() - radioHealth.retryMillis;
+    return true;
+  }
+
+  // The radio was found and working before the sleep, so there's no need to go through radioStarted() - RF24 has no way to pick
+  // the SPI bus back up without begin(), but that and our settings is all it takes.
+  radio = RF24(_cepin, _cspin, _spi_speed);
+  radioInitialized = true;
+  if (!startRadio())
+    radioFault("not answering after deep sleep");
+  else if (lowPower)
+    radioPowerDown();
+  else
+    enterRemoteCaptureMode();
+  return true;
+#else
+  return false;
+#endif
+}
+
+DirectolorPowerStats Directolor::powerStats()
+{
+  DirectolorPowerStats stats = power;
+  stats.awakeMillis += millis() - awakeSince;
+  if (listening)
+    stats.radioListenMillis += millis() - listeningSince;
+  return stats;
+}
+
+uint8_t Directolor::queuedCommandCount()
+{
+  uint8_t count = 0;
+  for (int i = 0; i < DIRECTOLOR_MAX_QUEUED_COMMANDS; i++)
+    if (commandItems[i].remote)
+      count++;
+  return count;
+}
+
+uint8_t Directolor::remoteIdFor(const uint8_t *radioCode)
+{
+  for (int i = 0; i < DIRECTOLOR_REMOTE_COUNT; i++)
+    if (!memcmp(remoteCodes[i].radioCode, radioCode, sizeof(remoteCodes[i].radioCode)))
+      return i + 1;
+  return 0;
+}
+
+bool Directolor::subscribe(DirectolorEventHandler handler, void *context)
+{
+  for (int i = 0; i < DIRECTOLOR_MAX_EVENT_SUBSCRIBERS; i++)
+  {
+    if (!eventSubscribers[i].handler)
+    {
+      eventSubscribers[i].handler = handler;
+      eventSubscribers[i].context = context;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Directolor::unsubscribe(DirectolorEventHandler handler, void *context)
+{
+  for (int i = 0; i < DIRECTOLOR_MAX_EVENT_SUBSCRIBERS; i++)
+    if (eventSubscribers[i].handler == handler && eventSubscribers[i].context == context)
+      eventSubscribers[i].handler = 0;
+}
+
+void Directolor::publishEvent(DirectolorEventType type, uint8_t remoteId, uint8_t channels, BlindAction blindAction, uint8_t attemptsRemaining, const uint8_t *radioCode)
+{
+  DirectolorEvent event;
+  event.type = type;
+  event.remoteId = remoteId;
+  event.channels = channels;
+  event.blindAction = blindAction;
+  event.attemptsRemaining = attemptsRemaining;
+  if (radioCode)
+    memcpy(event.radioCode, radioCode, sizeof(event.radioCode));
+  else
+    memset(event.radioCode, 0, sizeof(event.radioCode));
+  event.millis = millis();
+
+  for (int i = 0; i < DIRECTOLOR_MAX_EVENT_SUBSCRIBERS; i++)
+    if (eventSubscribers[i].handler)
+      eventSubscribers[i].handler(event, eventSubscribers[i].context);
+}
+
+void Directolor::setTransmitGate(DirectolorTransmitGate gate, void *context)
+{
+  transmitGate = gate;
+  transmitGateContext = context;
+}
+
+void Directolor::setCaptureLog(Print *log)
+{
+  captureLog = log;
+}
+
 void Directolor::enableSend()
 {
   lastInhibitDuration = 0;
@@ -21,52 +21,123 @@
 #include <SPI.h>
 #include <RF24.h>
 #include <stdint.h>
+#include "DirectolorProtocol.h"
 
 #define DIRECTOLOR_REMOTE_COUNT 7    // this should match the number of Radios in the RemoteCode const (bottom of this file)
 #define DIRECTOLOR_REMOTE_CHANNELS 6 // I tried to use 7 channels and it wouldn't work - looks like we're limited to 6   YMMV
 #define DIRECTOLOR_MAX_QUEUED_COMMANDS DIRECTOLOR_REMOTE_COUNT * 2
 
-#define COMMAND_CODE_LENGTH 17
-#define DUPLICATE_CODE_LENGTH 18
-#define GROUP_CODE_LENGTH 10
-#define STORE_FAV_CODE_LENGTH 15
+// MESSAGE_SEND_ATTEMPTS, MESSAGE_SEND_RETRIES and INTERMESSAGE_SEND_DELAY are in DirectolorProtocol.h, so the PC tools in extras use the same numbers
 
-#define MAX_PAYLOAD_SIZE 32 // maximum payload that you can send with the nRF24l01+
+#define DIRECTOLOR_RADIO_CHANNEL 53                  // remotes transmit at 2453 mHz
+#define DIRECTOLOR_SEARCH_CHANNELS 53                // radio channels to hop through while searching for a remote (comma separated)
+#define DIRECTOLOR_SEARCH_ADDRESS_WIDTHS 5, 4, 3     // address widths (of 0x55 preamble) to try on each search channel - shorter widths catch shorter preambles but see more noise
+#define DIRECTOLOR_SEARCH_DWELL_MS 250               // how long to listen at each channel / address width before moving on
 
-#define MESSAGE_SEND_ATTEMPTS 3         // this is the number of times we will generate and send the message (3 seems to work well for me, but feel free to change up or down as needed)
-#define MESSAGE_SEND_RETRIES 513        // the number of times to resend the message(seems like numbers > 400 are more reliable - feel free to change as necessary)
-#define INTERMESSAGE_SEND_DELAY 512 / 3 // the delay between message sends (if this is too low, the blinds seem to 'miss' messsages)
+#define DIRECTOLOR_MAX_EVENT_SUBSCRIBERS 4 // event handlers that can be subscribed at once (see subscribe below)
+
+#define DIRECTOLOR_RADIO_RETRY_MIN_MS 250   // wait before trying to start a missing radio again - doubled after each retry that fails
+#define DIRECTOLOR_RADIO_RETRY_MAX_MS 30000 // longest wait between attempts
+#define DIRECTOLOR_RADIO_PROBE_MS 2000      // how often a running radio's registers are checked while idle (they're also checked after every burst)
+
+#define DIRECTOLOR_IDLE_FOREVER 0xFFFFFFFFUL // idleMillis() with nothing queued
+#define DIRECTOLOR_MIN_LIGHT_SLEEP_MS 3      // sleep() doesn't bother with less than this - going in and out of light sleep costs about a millisecond
+#define DIRECTOLOR_MIN_DEEP_SLEEP_MS 1000    // deep sleep wakes through a reboot (a few hundred ms before setup() runs), so shorter waits are left to light sleep
+
+// Supply current in each state (microamps) for the energy estimate in directolorPowerMilliampHours() - datasheet typicals for a bare
+// nRF24L01+ at 0 dBm and an ESP32 with WiFi off.  Change them to suit your boards (a PA / LNA module draws far more on transmit).
+#define DIRECTOLOR_UA_AWAKE 50000
+#define DIRECTOLOR_UA_LIGHT_SLEEP 800
+#define DIRECTOLOR_UA_DEEP_SLEEP 10
+#define DIRECTOLOR_UA_RADIO_TX 11300
+#define DIRECTOLOR_UA_RADIO_LISTEN 13500
+#define DIRECTOLOR_UA_RADIO_POWER_DOWN 1
 
 #define DIRECTOLOR_CAPTURE_FIRST    // with this enabled, it will only show the first message when in capture mode, otherwise, it dumps every message it can - if you want to see full join or remove codes, you'll need to disable this.
 #define DIRECTOLOR_DEBUG_SENT_CODES // with this enabled, we'll dump the codes we're sending to the serial port
 
-enum BlindAction
+enum DirectolorEventType
+{
+    directolor_eventEnqueued,        // a command was queued, or merged into the one already queued for that remote and action
+    directolor_eventSuperseded,      // a later command with a different action took channels off a queued command
+    directolor_eventTransmitted,     // one burst of a command went out
+    directolor_eventCompleted,       // a command has gone out MESSAGE_SEND_ATTEMPTS times and left the queue
+    directolor_eventRemoteOverheard, // a physical remote press was decoded in capture mode
+    directolor_eventRadioDown,       // the radio failed to start, or stopped answering - commands wait in the queue until it's back
+    directolor_eventRadioUp          // the radio started (or came back)
+};
+
+struct DirectolorEvent
 {
-    directolor_open = 0x55,
-    directolor_close = 0x44,
-    directolor_tiltOpen = 0x52,
-    directolor_tiltClose = 0x4C,
-    directolor_stop = 0x53,
-    directolor_toFav = 0x48,
-    directolor_setFav = 6, // do this one in a bit...
-    directolor_join = 0x01,
-    directolor_remove = 0x00,
-    directolor_duplicate = 4
+    DirectolorEventType type;
+    uint8_t remoteId;          // 1 based - for remote overheard, the remoteCodes entry it matches, or 0 if it isn't one of them (see radioCode)
+    uint8_t channels;          // bit mask - for superseded, the channels that were taken off
+    BlindAction blindAction;   // for superseded, the action that lost the channels
+    uint8_t attemptsRemaining; // bursts still to go for the command
+    uint8_t radioCode[4];      // remote overheard only - the remote's code as dumpCodes() would print it
+    unsigned long millis;
 };
 
+struct DirectolorRadioStats
+{
+    bool up;
+    uint32_t sinceMillis;   // millis() of the last change between up and down
+    uint32_t upMillis;      // total time up / down, including the current stretch
+    uint32_t downMillis;
+    uint16_t startAttempts; // radio.begin() calls
+    uint16_t startFailures;
+    uint16_t faults;        // times a running radio was found broken - not answering, registers reset by a brown out, TX FIFO stuck
+    uint16_t failedBursts;  // bursts cut short by a fault (the command stayed queued)
+    uint32_t retryMillis;   // current wait between start attempts
+};
+
+struct DirectolorPowerStats
+{
+    uint32_t awakeMillis;
+    uint32_t lightSleepMillis;
+    uint32_t deepSleepMillis;
+    uint32_t radioTxMillis;     // bursts, including the power up delay
+    uint32_t radioListenMillis; // capture / search mode - any other time the radio is powered down or idle
+    uint16_t sleeps;
+    uint16_t wakes;                // wakes that were followed by a burst - the wake latency samples
+    uint32_t wakeLatencyMicros;    // last wake to start of burst (after deep sleep, from when the app started - the boot ROM isn't counted)
+    uint32_t wakeLatencyMaxMicros;
+    uint32_t wakeLatencyTotalMicros;
+};
+
+typedef void (*DirectolorEventHandler)(const DirectolorEvent &event, void *context);
+
+typedef bool (*DirectolorTransmitGate)(uint16_t burstMillis, void *context);
+
+inline const char *directolorEventName(DirectolorEventType type)
+{
+    static const char *const names[] = {"enqueued", "superseded", "transmitted", "completed", "remoteOverheard", "radioDown", "radioUp"};
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "unknown";
+}
+
+inline double directolorPowerMilliampHours(const DirectolorPowerStats &stats) // estimated charge used, from the DIRECTOLOR_UA_* figures
+{
+    double total = (double)stats.awakeMillis + stats.lightSleepMillis + stats.deepSleepMillis;
+    double radioActive = (double)stats.radioTxMillis + stats.radioListenMillis;
+    double microampMillis = (double)stats.awakeMillis * DIRECTOLOR_UA_AWAKE + (double)stats.lightSleepMillis * DIRECTOLOR_UA_LIGHT_SLEEP +
+                            (double)stats.deepSleepMillis * DIRECTOLOR_UA_DEEP_SLEEP + (double)stats.radioTxMillis * DIRECTOLOR_UA_RADIO_TX +
+                            (double)stats.radioListenMillis * DIRECTOLOR_UA_RADIO_LISTEN + (total > radioActive ? total - radioActive : 0) * DIRECTOLOR_UA_RADIO_POWER_DOWN;
+    return microampMillis / 3600000000.0;
+}
+
 class Directolor
 {
 
 public:
     Directolor(uint16_t _cepin, uint16_t _cspin, uint32_t _spi_speed = RF24_SPI_SPEED); // creates the interface and initializes the radio
 
-    static bool enterRemoteSearchMode(); // puts the code into search mode - when searching, you *must* be using a remote on only one channel and choose one of the regular buttons (open, close, stop, etc)
+    static bool enterRemoteSearchMode(); // puts the code into search mode - when searching, choose one of the regular buttons (open, close, stop, etc) on the remote - any channel(s) will do
 
     void dumpCodes(); // once in remote search mode, if you've found a remote, you can dump to get the codes, then place those found codes into the remoteCodes const at the bottom of this file (don't forget to update the DIRECTOLOR_REMOTE_COUNT #define at the top if you add one)
 
     bool sendCode(int remoteId, uint8_t channel, BlindAction blindAction); // send a code to a channel (1,2,3,4,5,6) - matches the buttons on the remote (even if you have a 3 button remote, you can still assign and use channels 4-6 with directolor, you just can't access them from the remote)
 
-    bool sendMultiChannelCode(int remoteId, uint8_t channels, BlindAction blindAction); // send a code to multiple channels - channels are a bit mask where the channel on the remote corresponds to 2 ^ (channel - 1).  For example, to send a command to channels 1 & 3, set channels = 5 (2^0 + 2^2)
+    bool sendMultiChannelCode(int remoteId, uint8_t channels, BlindAction blindAction); // send a code to multiple channels - channels are a bit mask where the channel on the remote corresponds to 2 ^ (channel - 1).  For example, to send a command to channels 1 & 3, set channels = 5 (2^0 + 2^2).  Commands are queued even while the radio is down - they go once it's back
 
     void inhibitSend(int durationMS); // maximum of 4 * INTERMESSAGE_SEND_DELAY (if you pass 0 it calls enabledSend()) - use this if, for example, you are also using a 433mhz radio that sends codes as well.  You'd want to inhibitSend on directolor while sending those other codes to avoid shades missing commands
 
@@ -74,29 +145,57 @@ public:
 
     void processLoop();
 
+    static uint8_t queuedCommandCount(); // commands waiting in the queue (each still has up to MESSAGE_SEND_ATTEMPTS bursts to go)
+
+    static bool subscribe(DirectolorEventHandler handler, void *context = 0); // handler is called for every DirectolorEvent, straight from processLoop() / sendMultiChannelCode() - keep it short, and queue anything that calls back into Directolor rather than calling it from the handler.  Returns false if DIRECTOLOR_MAX_EVENT_SUBSCRIBERS are already subscribed
+
+    static void unsubscribe(DirectolorEventHandler handler, void *context = 0);
+
+    static void setTransmitGate(DirectolorTransmitGate gate, void *context = 0); // gate is asked before every burst (burstMillis is how long it's expected to keep the air) - returning false holds the command in the queue until a later processLoop().  Used to share the air with other transmitters, e.g. the example's multi controller coordination.  Pass 0 to remove
+
+    static void setLowPower(bool enabled); // powers the radio down between bursts instead of listening in capture mode (search mode still listens) - for controllers that sleep
+
+    static unsigned long idleMillis(); // how long processLoop() can go uncalled without holding up a burst - 0 if one is due (or search mode is listening), DIRECTOLOR_IDLE_FOREVER if nothing is queued.  While the radio is missing it includes the wait for the next start attempt, so a controller can (deep) sleep through the backoff with commands queued
+
+#ifdef ESP32
+    bool sleep(unsigned long maxMillis = DIRECTOLOR_IDLE_FOREVER, int wakePin = -1, bool deep = false); // sleeps for idleMillis() (at most maxMillis) with the radio powered down, waking early if wakePin is pulled low (a button to ground - deep sleep needs an RTC GPIO).  Deep sleep keeps the queue (and the radio backoff) in RTC memory and doesn't return - call resume() first thing in setup().  With a working radio the gaps between bursts are too short for deep sleep, so the queue only survives it when the radio was backing off.  Returns false if the wait was too short to be worth sleeping, or if there is nothing to wake it - nothing queued with no maxMillis and no wakePin
+#endif
+
+    bool resume(); // call in setup() - after a deep sleep() this puts the queue back and restarts the radio without the full radioStarted() init, so the pending bursts go out without waiting for anything else (e.g. WiFi).  If the radio was backing off, the next start attempt is due straight away instead.  Returns false on a normal boot
+
+    static DirectolorRadioStats radioStats(); // radio uptime, start attempts and faults
+
+    static DirectolorPowerStats powerStats(); // time in each power state (kept through deep sleep) and wake latency - see directolorPowerMilliampHours()
+
+    static void setCaptureLog(Print *log); // every payload the radio receives is appended to log as a DirectolorCaptureRecord (see DirectolorProtocol.h) - pass an SD / LittleFS File opened for append, or Serial to stream it to a PC.  Pass 0 to stop.
+
 private:
-    typedef struct CommandItem
-    {
-        uint8_t *radioCodes;
-        uint8_t channels;
-        BlindAction blindAction;
-        uint8_t resendRemainingCount;
-    };
+    typedef DirectolorQueueEntry CommandItem; // packed to bytes, with the remote as an index, so the queue stays small (and goes into RTC memory as is)
 
     struct RemoteCode
     {
         uint8_t radioCode[4];
     };
 
-    uint8_t storeFavPrototype[25] = {0x55, 0x55, 0x55, 0X11, 0X11, 0xC0, 0x0F, 0x00, 0x05, 0x2B, 0xFF, 0xFF, 0xBB, 0x0D, 0x86, 0x04, 0x20, 0xBB, 0x0D, 0x63, 0x49, 0x00, 0xC4, 0x10, 0XAA};
-
-    static const uint8_t matchPattern[4]; // this is what we use to find out what the codes for the remote are
+    struct EventSubscriber
+    {
+        DirectolorEventHandler handler;
+        void *context;
+    };
 
     static RF24 radio;
     static bool messageIsSending;
     static bool learningRemote;
     static bool radioValid;
     static RemoteCode remoteCode;
+    static DirectolorRemoteMatcher remoteMatcher;
+    static const uint8_t searchChannels[];
+    static const uint8_t searchAddressWidths[];
+    static uint8_t searchStep;
+    static uint8_t searchStepCount; // every step taken, wrapping - goes in capture records so a replay knows where the matcher was reset
+    static unsigned long searchStepMillis;
+    static unsigned long searchStartMillis;
+    static uint32_t searchPayloadCount;
     static unsigned long lastMillis;
     static CommandItem commandItems[DIRECTOLOR_MAX_QUEUED_COMMANDS];
     static short lastCommand;
@@ -107,15 +206,53 @@ private:
 
     static bool sendCode(byte *payload, uint8_t payloadSize);
     static bool radioStarted();
+    static bool startRadio();
+    static bool radioHealthy();
+    static void radioFault(const char *reason);
+    static void setRadioUp(bool up);
     static void checkRadioPayload();
     static bool checkMessageIsSending();
     static void printData(char payload[], int start, int count, char *separator = " ");
     static void enterRemoteCaptureMode();
+    static void configureRemoteSearch();
+    static Print *captureLog;
+    static EventSubscriber eventSubscribers[DIRECTOLOR_MAX_EVENT_SUBSCRIBERS];
+    static DirectolorTransmitGate transmitGate;
+    static void *transmitGateContext;
+    struct SleepState // what deep sleep keeps in RTC memory
+    {
+        uint32_t magic;
+        CommandItem commands[DIRECTOLOR_MAX_QUEUED_COMMANDS];
+        short lastCommand;
+        RemoteCode remoteCode; // capture mode address
+        uint16_t burstMillis;
+        bool lowPower;
+        int64_t sleptAtMicros; // wall clock (it keeps running in deep sleep)
+        DirectolorPowerStats power;
+        DirectolorRadioStats radio; // with a radio backoff still running if it slept through one
+    };
+
+    static DirectolorRadioStats radioHealth;
+    static unsigned long lastRadioAttempt;
+    static unsigned long lastRadioProbe;
+    static bool lowPower;
+    static SleepState sleepState;
+    static DirectolorPowerStats power;
+    static unsigned long awakeSince;
+    static bool listening;
+    static unsigned long listeningSince;
+    static unsigned long wakeMicros;
+    static bool wakePending; // woke up and the first burst hasn't gone yet
+    static void configureRadio();
+    static void radioListening(bool listening);
+    static void radioPowerDown();
+    static uint16_t burstMillis; // how long the last frame's burst took - the transmit gate is told to expect that (per frame) plus the power up delay
+    static void publishEvent(DirectolorEventType type, uint8_t remoteId, uint8_t channels, BlindAction blindAction, uint8_t attemptsRemaining, const uint8_t *radioCode = 0);
+    static uint8_t remoteIdFor(const uint8_t *radioCode);
     static int getRadioCommand(byte *payload, CommandItem commandItem);
-    static int getDuplicateRadioCommand(byte *payload, CommandItem commandItem);
-    static int getGroupRadioCommand(byte *payload, CommandItem commandItem);
+    static void onSuperseded(const CommandItem &commandItem, uint8_t channels, void *context);
 
-    const RemoteCode remoteCodes[DIRECTOLOR_REMOTE_COUNT] =
+    static constexpr RemoteCode remoteCodes[DIRECTOLOR_REMOTE_COUNT] = // constexpr, so it's in flash rather than RAM
         {
             /*
              * Radio:  12 F0 78 09
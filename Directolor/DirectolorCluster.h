@@ -0,0 +1,577 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  Project home: https://github.com/sui77/rc-switch/
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Coordination between several Directolor controllers on one LAN, so they share the house without transmitting over each other.
+// Plain C++ with no sockets and no clock - the caller passes datagrams and the time in, and gets datagrams and commands out through
+// the two handlers - so the same code runs in the web example (ControlCluster) and in extras/ClusterNode on a PC.
+//
+//   discovery   every node sends a heartbeat every DIRECTOLOR_CLUSTER_HEARTBEAT_MS; a node not heard from for
+//               DIRECTOLOR_CLUSTER_TIMEOUT_MS is gone.  A new node listens for that long (or until it hears a leader) before it
+//               takes part, so it doesn't start out believing it is alone - until then the others leave it out of everything.
+//   leader      the node with the lowest id.  Nothing is negotiated - every node works it out from the heartbeats it has heard.
+//   affinity    each node says which channels of which remotes it reaches well (setAffinity - typically the shades nearest to it).
+//               A command is split by channel and each part goes to its owner: the lowest id node claiming the channel, or the
+//               leader if none does.  So a command that reaches two nodes (a hub sending to both) still goes out once.
+//   slots       the leader's heartbeat carries the schedule - the member list and the frame phase.  Each member gets a
+//               DIRECTOLOR_CLUSTER_SLOT_MS slot in turn, and a burst only starts if it fits in what is left of the node's slot.
+//   failover    a forwarded command that isn't acked after DIRECTOLOR_CLUSTER_FORWARD_ATTEMPTS tries is queued locally instead.
+//               When a node times out, its channels go to the next owner, and when the leader times out the next lowest id takes
+//               over.  A new leader starts its first frame one slot late, so a burst the old one had started can finish.  Once a
+//               forward is acked it is the owner's - if the owner dies before its bursts go out, that command is lost.
+//   starting    commands that arrive before this node has settled in (discovery over, and every node it knows of in the leader's
+//               schedule) are held, then routed as everyone else did - so nodes starting together don't each send them while they
+//               believe they are alone.  A node joining a running cluster routes what it got while discovering without itself, as
+//               the others did.
+//
+// join / remove / duplicate are always sent by the node that got them - pairing is done standing next to a shade, and duplicate has
+// to go out from the same radio just before the join.
+#ifndef _DirectolorCluster_h
+#define _DirectolorCluster_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "DirectolorProtocol.h"
+#include "DirectolorUdp.h"
+
+#define DIRECTOLOR_CLUSTER_PORT 2454
+#define DIRECTOLOR_CLUSTER_MAX_NODES 8           // including this one
+#define DIRECTOLOR_CLUSTER_REMOTES 16            // remotes in the affinity table (has to cover DIRECTOLOR_REMOTE_COUNT)
+#define DIRECTOLOR_CLUSTER_HEARTBEAT_MS 1000
+#define DIRECTOLOR_CLUSTER_TIMEOUT_MS 3500       // three missed heartbeats and a bit
+#define DIRECTOLOR_CLUSTER_SLOT_MS 600           // has to be longer than a set favorite (two bursts) - bursts longer than a slot are held to one per slot
+#define DIRECTOLOR_CLUSTER_GUARD_MS 40           // end of each slot left quiet, for the nodes' idea of the frame phase being a little off
+#define DIRECTOLOR_CLUSTER_FORWARD_TIMEOUT_MS 250 // per try - all the tries together have to outlast a slot, as the owner doesn't ack while loop() is in a burst
+#define DIRECTOLOR_CLUSTER_FORWARD_ATTEMPTS 3
+#define DIRECTOLOR_CLUSTER_MAX_FORWARDS 8        // forwarded commands waiting for an ack - more than that are sent locally
+#define DIRECTOLOR_CLUSTER_MAX_HELD 8            // commands held while a node starts up (see settled()) - more than that are sent locally
+
+#define DIRECTOLOR_CLUSTER_MAGIC 'C'
+#define DIRECTOLOR_CLUSTER_VERSION 1
+#define DIRECTOLOR_CLUSTER_HEADER_SIZE 7 // 'C'  version  type  node id (4 bytes, little endian)
+#define DIRECTOLOR_CLUSTER_MAX_DATAGRAM (DIRECTOLOR_CLUSTER_HEADER_SIZE + DIRECTOLOR_CLUSTER_REMOTES + 6 + DIRECTOLOR_CLUSTER_MAX_NODES * 4)
+
+enum DirectolorClusterType
+{
+    directolor_clusterHeartbeat = 1,  // affinity[DIRECTOLOR_CLUSTER_REMOTES]  ready  members  (if members: slot ms (2)  phase ms (2, signed)  member ids (4 each))
+    directolor_clusterForward = 2,    // target id (4)  sequence (2)  remote  channels  action
+    directolor_clusterForwardAck = 3  // target id (4)  sequence (2)
+};
+
+class DirectolorCluster
+{
+public:
+    typedef void (*SendHandler)(const uint8_t *data, uint8_t length, void *context);                  // send to every node (broadcast / multicast)
+    typedef void (*EnqueueHandler)(uint8_t remote, uint8_t channels, uint8_t action, void *context); // queue on this node's radio
+
+    DirectolorCluster(uint32_t nodeId, SendHandler send, EnqueueHandler enqueue, void *context)
+        : nodeId(nodeId), sendHandler(send), enqueueHandler(enqueue), context(context), started(false), discovering(true), startedAt(0),
+          lastHeartbeat(0), leaderId(0), membershipChanged(false), memberCount(0), slotMs(DIRECTOLOR_CLUSTER_SLOT_MS), frameOrigin(0),
+          scheduleFrom(0), scheduleAt(0), forwardSequence(0), holding(false), heardAnyone(false), joinedRunning(false), heldCount(0)
+    {
+        memset(affinity, 0, sizeof(affinity));
+        memset(forwards, 0, sizeof(forwards));
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1; i++)
+            peers[i].id = 0;
+    }
+
+    void setAffinity(uint8_t remote, uint8_t channels) // remote is 1 based, channels a bit mask - call before begin()
+    {
+        if (remote >= 1 && remote <= DIRECTOLOR_CLUSTER_REMOTES)
+            affinity[remote - 1] = channels;
+    }
+
+    void begin(uint32_t now)
+    {
+        started = true;
+        discovering = true;
+        holding = true;
+        heardAnyone = false;
+        joinedRunning = false;
+        startedAt = now;
+        leaderId = 0;
+        sendHeartbeat(now);
+    }
+
+    // Call often (every loop) - heartbeats, timeouts, election and forward resends happen here.
+    void poll(uint32_t now)
+    {
+        if (!started)
+            return;
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1; i++)
+        {
+            if (peers[i].id && now - peers[i].lastHeard > DIRECTOLOR_CLUSTER_TIMEOUT_MS)
+            {
+                peers[i].id = 0;
+                membershipChanged = true;
+            }
+        }
+        if (discovering && now - startedAt >= DIRECTOLOR_CLUSTER_TIMEOUT_MS)
+            finishDiscovery(now);
+        elect(now);
+        if (holding && leaderId && (settled() || now - startedAt >= 2 * DIRECTOLOR_CLUSTER_TIMEOUT_MS)) // don't hold on for ever if the leader never takes us in
+        {
+            holding = false;
+            for (uint8_t i = 0; i < heldCount; i++)
+                split(held[i].remote, held[i].channels, held[i].action, now, !(held[i].whileDiscovering && joinedRunning));
+            heldCount = 0;
+        }
+
+        if (now - lastHeartbeat >= DIRECTOLOR_CLUSTER_HEARTBEAT_MS)
+            sendHeartbeat(now);
+
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_FORWARDS; i++)
+        {
+            Forward &forward = forwards[i];
+            if (!forward.target || now - forward.sentAt < DIRECTOLOR_CLUSTER_FORWARD_TIMEOUT_MS)
+                continue;
+            if (forward.attempts < DIRECTOLOR_CLUSTER_FORWARD_ATTEMPTS && peerFor(forward.target))
+                sendForward(forward, now);
+            else
+            {
+                enqueueHandler(forward.remote, forward.channels, forward.action, context); // owner didn't answer - better twice than never
+                forward.target = 0;
+            }
+        }
+    }
+
+    void receive(const uint8_t *data, size_t length, uint32_t now) // now - when the datagram arrived, if that's known (the frame phase is worked out from it)
+    {
+        if (!started || length < DIRECTOLOR_CLUSTER_HEADER_SIZE || data[0] != DIRECTOLOR_CLUSTER_MAGIC || data[1] != DIRECTOLOR_CLUSTER_VERSION)
+            return;
+        uint32_t from = readId(data + 3);
+        if (!from || from == nodeId) // our own broadcast coming back
+            return;
+        const uint8_t *body = data + DIRECTOLOR_CLUSTER_HEADER_SIZE;
+        length -= DIRECTOLOR_CLUSTER_HEADER_SIZE;
+
+        switch (data[2])
+        {
+        case directolor_clusterHeartbeat:
+            receiveHeartbeat(from, body, length, now);
+            break;
+        case directolor_clusterForward:
+            if (length == 9 && readId(body) == nodeId)
+            {
+                uint16_t sequence = body[4] | body[5] << 8;
+                Peer *peer = peerFor(from);
+                if (!peer || peer->forwards.check(sequence) == DirectolorUdpSequenceWindow::fresh)
+                    enqueueHandler(body[6], body[7], body[8], context);
+                uint8_t ack[DIRECTOLOR_CLUSTER_HEADER_SIZE + 6]; // acked even if it was a resend - the first ack may be what got lost
+                uint8_t ackLength = writeHeader(ack, directolor_clusterForwardAck);
+                writeId(ack + ackLength, from);
+                ack[ackLength + 4] = sequence;
+                ack[ackLength + 5] = sequence >> 8;
+                sendHandler(ack, ackLength + 6, context);
+            }
+            break;
+        case directolor_clusterForwardAck:
+            if (length == 6 && readId(body) == nodeId)
+            {
+                uint16_t sequence = body[4] | body[5] << 8;
+                for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_FORWARDS; i++)
+                    if (forwards[i].target == from && forwards[i].sequence == sequence)
+                        forwards[i].target = 0;
+            }
+            break;
+        }
+    }
+
+    // A command from a hub / the web page - each channel is queued here or forwarded to the node that owns it.
+    void route(uint8_t remote, uint8_t channels, uint8_t action, uint32_t now)
+    {
+        if (!started || action == directolor_join || action == directolor_remove || action == directolor_duplicate)
+        {
+            enqueueHandler(remote, channels, action, context);
+            return;
+        }
+        if (holding) // just started - see settled()
+        {
+            if (heldCount == DIRECTOLOR_CLUSTER_MAX_HELD)
+            {
+                enqueueHandler(remote, channels, action, context); // better twice than never
+                return;
+            }
+            Held &held = this->held[heldCount++];
+            held.remote = remote;
+            held.channels = channels;
+            held.action = action;
+            held.whileDiscovering = discovering;
+            return;
+        }
+        split(remote, channels, action, now, true);
+    }
+
+    // Ask before every burst - true if burstMs fits in what is left of this node's slot.
+    bool mayTransmit(uint16_t burstMs, uint32_t now) const
+    {
+        if (!started)
+            return true; // not clustered
+        if (discovering || !leaderId)
+            return false;
+        if (leaderId != nodeId && (scheduleFrom != leaderId || now - scheduleAt > DIRECTOLOR_CLUSTER_TIMEOUT_MS))
+            return false; // new leader - wait for its schedule
+        if (memberCount == 1 && members[0] == nodeId)
+            return true; // alone
+
+        uint8_t slot = 0;
+        while (slot < memberCount && members[slot] != nodeId)
+            slot++;
+        if (slot == memberCount)
+            return false; // the leader hasn't heard us yet
+
+        int32_t sinceOrigin = (int32_t)(now - frameOrigin);
+        if (sinceOrigin < 0)
+            return false;
+        uint32_t intoFrame = (uint32_t)sinceOrigin % ((uint32_t)slotMs * memberCount);
+        uint32_t slotStart = (uint32_t)slot * slotMs;
+        if (burstMs > slotMs - DIRECTOLOR_CLUSTER_GUARD_MS)
+            burstMs = slotMs - DIRECTOLOR_CLUSTER_GUARD_MS;
+        return intoFrame >= slotStart && intoFrame + burstMs + DIRECTOLOR_CLUSTER_GUARD_MS <= slotStart + slotMs;
+    }
+
+    uint32_t ownerOf(uint8_t remote, uint8_t channel) const // channel as a bit - the node that transmits it
+    {
+        return ownerAmong(remote, channel, true);
+    }
+
+    uint32_t id() const { return nodeId; }
+    uint32_t leader() const { return leaderId; } // 0 while discovering
+    bool isLeader() const { return leaderId && leaderId == nodeId; }
+    bool isDiscovering() const { return discovering; }
+    uint8_t nodeCount() const
+    {
+        uint8_t count = 1;
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1; i++)
+            count += peers[i].id != 0;
+        return count;
+    }
+
+private:
+    struct Peer
+    {
+        uint32_t id; // 0 - free
+        uint32_t lastHeard;
+        bool ready; // past its discovery period - only then does it lead, own shades or get a slot
+        uint8_t affinity[DIRECTOLOR_CLUSTER_REMOTES];
+        DirectolorUdpSequenceWindow forwards; // so a resent forward isn't queued twice
+    };
+
+    struct Held
+    {
+        uint8_t remote;
+        uint8_t channels;
+        uint8_t action;
+        bool whileDiscovering; // the others didn't count us in yet
+    };
+
+    struct Forward
+    {
+        uint32_t target; // 0 - free
+        uint16_t sequence;
+        uint8_t remote;
+        uint8_t channels;
+        uint8_t action;
+        uint8_t attempts;
+        uint32_t sentAt;
+    };
+
+    uint32_t nodeId;
+    SendHandler sendHandler;
+    EnqueueHandler enqueueHandler;
+    void *context;
+    uint8_t affinity[DIRECTOLOR_CLUSTER_REMOTES];
+    Peer peers[DIRECTOLOR_CLUSTER_MAX_NODES - 1];
+    Forward forwards[DIRECTOLOR_CLUSTER_MAX_FORWARDS];
+    bool started;
+    bool discovering;
+    uint32_t startedAt;
+    uint32_t lastHeartbeat;
+    uint32_t leaderId;
+    bool membershipChanged;
+    uint32_t members[DIRECTOLOR_CLUSTER_MAX_NODES]; // the schedule - slot n belongs to members[n]
+    uint8_t memberCount;
+    uint16_t slotMs;
+    uint32_t frameOrigin; // local time slot 0 of a frame started
+    uint32_t scheduleFrom;
+    uint32_t scheduleAt;
+    uint16_t forwardSequence;
+    bool holding;       // from begin() until settled() - commands are held rather than routed
+    bool heardAnyone;   // since begin()
+    bool joinedRunning; // the first node heard was already past discovery - we came up in a running cluster
+    Held held[DIRECTOLOR_CLUSTER_MAX_HELD];
+    uint8_t heldCount;
+
+    static uint32_t readId(const uint8_t *data) { return data[0] | data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24; }
+
+    static void writeId(uint8_t *data, uint32_t id)
+    {
+        data[0] = id;
+        data[1] = id >> 8;
+        data[2] = id >> 16;
+        data[3] = id >> 24;
+    }
+
+    uint8_t writeHeader(uint8_t *data, uint8_t type) const
+    {
+        data[0] = DIRECTOLOR_CLUSTER_MAGIC;
+        data[1] = DIRECTOLOR_CLUSTER_VERSION;
+        data[2] = type;
+        writeId(data + 3, nodeId);
+        return DIRECTOLOR_CLUSTER_HEADER_SIZE;
+    }
+
+    Peer *peerFor(uint32_t id)
+    {
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1; i++)
+            if (peers[i].id == id)
+                return &peers[i];
+        return 0;
+    }
+
+    // A command is split by channel and each part queued here or forwarded to its owner.  self false - as the others see it while we
+    // are still discovering.
+    void split(uint8_t remote, uint8_t channels, uint8_t action, uint32_t now, bool self)
+    {
+        while (channels)
+        {
+            uint32_t target = ownerAmong(remote, channels & -channels, self);
+            uint8_t owned = 0;
+            for (uint8_t bit = 1; bit; bit <<= 1)
+                if ((channels & bit) && ownerAmong(remote, bit, self) == target)
+                    owned |= bit;
+            channels &= ~owned;
+
+            if (target == nodeId)
+                enqueueHandler(remote, owned, action, context);
+            else
+                forward(target, remote, owned, action, now);
+        }
+    }
+
+    uint32_t ownerAmong(uint8_t remote, uint8_t channel, bool self) const
+    {
+        uint32_t owner = 0;
+        if (remote >= 1 && remote <= DIRECTOLOR_CLUSTER_REMOTES)
+        {
+            if (self && (affinity[remote - 1] & channel))
+                owner = nodeId;
+            for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1; i++)
+                if (peers[i].id && peers[i].ready && (peers[i].affinity[remote - 1] & channel) && (!owner || peers[i].id < owner))
+                    owner = peers[i].id;
+        }
+        if (owner)
+            return owner;
+        if (self)
+            return leaderId;
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1; i++) // the leader the others had without us
+            if (peers[i].id && peers[i].ready && (!owner || peers[i].id < owner))
+                owner = peers[i].id;
+        return owner ? owner : leaderId;
+    }
+
+    // Every node we know of is past discovery and in the leader's schedule, this one included - so the others route with the same
+    // view of who owns what as we do.  Until then commands are held: nodes starting together would otherwise each take them while
+    // they believe they are alone, or lead.
+    bool settled() const
+    {
+        if (discovering || !leaderId || scheduleFrom != leaderId)
+            return false;
+        uint8_t known = 1;
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1; i++)
+        {
+            if (peers[i].id && !peers[i].ready)
+                return false;
+            known += peers[i].id != 0;
+        }
+        bool scheduled = false;
+        for (uint8_t i = 0; i < memberCount; i++)
+            scheduled |= members[i] == nodeId;
+        return scheduled && memberCount == known;
+    }
+
+    void elect(uint32_t now)
+    {
+        uint32_t lowest = discovering ? 0 : nodeId;
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1 && lowest; i++)
+            if (peers[i].id && peers[i].ready && peers[i].id < lowest)
+                lowest = peers[i].id;
+
+        bool takingOver = lowest == nodeId && leaderId != nodeId;
+        leaderId = lowest;
+        if (!isLeader() || (!takingOver && !membershipChanged))
+            return;
+
+        memberCount = 0; // member list sorted by id - the order of the slots
+        uint32_t previous = 0;
+        for (uint8_t n = 0; n < DIRECTOLOR_CLUSTER_MAX_NODES; n++)
+        {
+            uint32_t next = 0;
+            if (nodeId > previous)
+                next = nodeId;
+            for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES - 1; i++)
+                if (peers[i].id > previous && peers[i].ready && (!next || peers[i].id < next))
+                    next = peers[i].id;
+            if (!next)
+                break;
+            members[memberCount++] = previous = next;
+        }
+        slotMs = DIRECTOLOR_CLUSTER_SLOT_MS;
+        if (takingOver)
+            frameOrigin = now + slotMs; // let a burst the old leader's schedule allowed finish first
+        scheduleFrom = nodeId;
+        scheduleAt = now;
+        membershipChanged = false;
+        sendHeartbeat(now); // everyone needs the new schedule now, not at the next heartbeat
+    }
+
+    void finishDiscovery(uint32_t now)
+    {
+        discovering = false;
+        sendHeartbeat(now); // so the others count us in straight away
+    }
+
+    void sendHeartbeat(uint32_t now)
+    {
+        uint8_t data[DIRECTOLOR_CLUSTER_MAX_DATAGRAM];
+        uint8_t length = writeHeader(data, directolor_clusterHeartbeat);
+        memcpy(data + length, affinity, sizeof(affinity));
+        length += sizeof(affinity);
+        data[length++] = !discovering;
+        if (isLeader())
+        {
+            int16_t phase = (int32_t)(now - frameOrigin) < 0 ? -(int16_t)(frameOrigin - now) : (now - frameOrigin) % ((uint32_t)slotMs * memberCount);
+            data[length++] = memberCount;
+            data[length++] = slotMs;
+            data[length++] = slotMs >> 8;
+            data[length++] = phase;
+            data[length++] = (uint16_t)phase >> 8;
+            for (uint8_t i = 0; i < memberCount; i++, length += 4)
+                writeId(data + length, members[i]);
+        }
+        else
+            data[length++] = 0;
+        sendHandler(data, length, context);
+        lastHeartbeat = now;
+    }
+
+    void receiveHeartbeat(uint32_t from, const uint8_t *body, size_t length, uint32_t now)
+    {
+        if (length < DIRECTOLOR_CLUSTER_REMOTES + 2)
+            return;
+        Peer *peer = peerFor(from);
+        if (!peer && (peer = peerFor(0)) != 0) // table full - the extra node is ignored (and never gets a slot, so it stays quiet)
+        {
+            peer->id = from;
+            peer->ready = false;
+            peer->forwards.reset();
+        }
+        if (!peer)
+            return;
+        if (!heardAnyone)
+        {
+            heardAnyone = true;
+            joinedRunning = body[DIRECTOLOR_CLUSTER_REMOTES] != 0;
+        }
+        peer->lastHeard = now;
+        memcpy(peer->affinity, body, DIRECTOLOR_CLUSTER_REMOTES);
+        if (peer->ready != (body[DIRECTOLOR_CLUSTER_REMOTES] != 0))
+        {
+            peer->ready = !peer->ready;
+            membershipChanged = true;
+        }
+
+        uint8_t count = body[DIRECTOLOR_CLUSTER_REMOTES + 1];
+        const uint8_t *schedule = body + DIRECTOLOR_CLUSTER_REMOTES + 2;
+        if (count && count <= DIRECTOLOR_CLUSTER_MAX_NODES && length == DIRECTOLOR_CLUSTER_REMOTES + 6 + count * 4u)
+        {
+            if (discovering)
+                finishDiscovery(now); // there is a leader - no need to wait out the discovery period
+            elect(now);
+            if (from == leaderId)
+            {
+                uint16_t newSlotMs = schedule[0] | schedule[1] << 8;
+                int16_t phase = schedule[2] | schedule[3] << 8;
+                bool changed = scheduleFrom != from || newSlotMs != slotMs || count != memberCount;
+                for (uint8_t i = 0; i < count; i++)
+                {
+                    uint32_t member = readId(schedule + 4 + i * 4);
+                    changed |= members[i] != member;
+                    members[i] = member;
+                }
+                slotMs = newSlotMs;
+                memberCount = count;
+
+                // A heartbeat can only arrive late (WiFi, or loop() busy with a burst), and late makes the frame look like it started
+                // later than it did - so keep the earliest estimate, and only creep forward to follow clock drift.
+                uint32_t frameMs = (uint32_t)slotMs * memberCount;
+                int32_t difference = (int32_t)(now - phase - frameOrigin) % (int32_t)frameMs;
+                if (difference > (int32_t)frameMs / 2)
+                    difference -= frameMs;
+                else if (difference <= -(int32_t)frameMs / 2)
+                    difference += frameMs;
+                if (changed)
+                    frameOrigin = now - phase;
+                else if (difference < 0)
+                    frameOrigin += difference;
+                else if (difference > 0)
+                    frameOrigin++;
+                scheduleFrom = from;
+                scheduleAt = now;
+            }
+        }
+        else
+            elect(now);
+    }
+
+    void forward(uint32_t target, uint8_t remote, uint8_t channels, uint8_t action, uint32_t now)
+    {
+        for (uint8_t i = 0; i < DIRECTOLOR_CLUSTER_MAX_FORWARDS; i++)
+        {
+            if (forwards[i].target)
+                continue;
+            Forward &forward = forwards[i];
+            forward.target = target;
+            forward.sequence = ++forwardSequence;
+            forward.remote = remote;
+            forward.channels = channels;
+            forward.action = action;
+            forward.attempts = 0;
+            sendForward(forward, now);
+            return;
+        }
+        enqueueHandler(remote, channels, action, context); // too many waiting for acks
+    }
+
+    void sendForward(Forward &forward, uint32_t now)
+    {
+        uint8_t data[DIRECTOLOR_CLUSTER_HEADER_SIZE + 9];
+        uint8_t length = writeHeader(data, directolor_clusterForward);
+        writeId(data + length, forward.target);
+        data[length + 4] = forward.sequence;
+        data[length + 5] = forward.sequence >> 8;
+        data[length + 6] = forward.remote;
+        data[length + 7] = forward.channels;
+        data[length + 8] = forward.action;
+        sendHandler(data, length + 9, context);
+        forward.attempts++;
+        forward.sentAt = now;
+    }
+};
+
+#endif
@@ -8,6 +8,7 @@ struct Directolor_Cover {
   int time_for_full_movement;
   int remote;
   int blind;
+  int favorite_position;  // percent open the shade's favorite is stored at (0 = no favorite) - requests for it use one toFav burst instead of move + timed stop
 };
 
 const int time_for_full_tilt = 5;
@@ -69,6 +70,14 @@ class DirectolorCover : public Component, public Cover {
   void setValues(Directolor_Cover cover_settings) {
      this->cover_settings = cover_settings;
 }
+
+  void store_favorite() {
+    // stores where the shade is now as its favorite - move it there first (the position is assumed, like everything else here)
+    directolor.sendCode(this->cover_settings.remote, this->cover_settings.blind, directolor_setFav);
+    this->cover_settings.favorite_position = (int)(this->position * 100 + 0.5);
+    ESP_LOGD("Directolor", "Storing favorite for %d-%d at %d%%", this->cover_settings.remote, this->cover_settings.blind, this->cover_settings.favorite_position);
+  }
+
   CoverTraits get_traits() override {
     auto traits = CoverTraits();
     traits.set_is_assumed_state(true);
@@ -86,6 +95,11 @@ class DirectolorCover : public Component, public Cover {
 	 directolor.sendCode(this->cover_settings.remote, this->cover_settings.blind, directolor_close);
       else if (pos == 1)
          directolor.sendCode(this->cover_settings.remote, this->cover_settings.blind,directolor_open);
+      else if (this->cover_settings.favorite_position != 0 && abs(pos * 100 - this->cover_settings.favorite_position) < 1) {
+         directolor.sendCode(this->cover_settings.remote, this->cover_settings.blind, directolor_toFav);  // one burst, the shade stops itself
+         millis_at_stop = 0;
+         ESP_LOGD("Directolor", "requested position %.2f is the favorite", pos);
+      }
       else {
 	if (this->position == pos)
 	 {
@@ -0,0 +1,536 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  Project home: https://github.com/sui77/rc-switch/
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Everything in here is plain C++ (no Arduino, no RF24) so it can be compiled on a PC as well as on the ESP32.
+#ifndef _DirectolorProtocol_h
+#define _DirectolorProtocol_h
+
+#include <stdint.h>
+
+#define COMMAND_CODE_LENGTH 17
+#define DUPLICATE_CODE_LENGTH 18
+#define GROUP_CODE_LENGTH 10
+#define STORE_FAV_CODE_LENGTH 15
+
+#define MAX_PAYLOAD_SIZE 32 // maximum payload that you can send with the nRF24l01+
+
+#define MESSAGE_SEND_ATTEMPTS 3         // this is the number of times we will generate and send the message (3 seems to work well for me, but feel free to change up or down as needed)
+#define MESSAGE_SEND_RETRIES 513        // the number of times to resend the message(seems like numbers > 400 are more reliable - feel free to change as necessary)
+#define INTERMESSAGE_SEND_DELAY 512 / 3 // the delay between message sends (if this is too low, the blinds seem to 'miss' messsages)
+#define DIRECTOLOR_POWER_UP_DELAY_MS 20 // wait between powering the radio up and the first packet of every burst (the first command seems to be weak without it)
+
+enum BlindAction
+{
+    directolor_open = 0x55,
+    directolor_close = 0x44,
+    directolor_tiltOpen = 0x52,
+    directolor_tiltClose = 0x4C,
+    directolor_stop = 0x53,
+    directolor_toFav = 0x48,
+    directolor_setFav = 6, // not an action byte - sends a stop to the channels followed by a store favorite frame (STORE_FAV_CODE_LENGTH), so the shades store where they are
+    directolor_join = 0x01,
+    directolor_remove = 0x00,
+    directolor_duplicate = 4
+};
+
+struct DirectolorActionName
+{
+    const char *name;
+    uint8_t action; // BlindAction
+};
+
+// names used by the web / serial interfaces (matched case insensitively)
+static const DirectolorActionName directolorActionNames[] = {
+    {"open", directolor_open},
+    {"close", directolor_close},
+    {"tiltOpen", directolor_tiltOpen},
+    {"tiltClose", directolor_tiltClose},
+    {"stop", directolor_stop},
+    {"toFav", directolor_toFav},
+    {"setFav", directolor_setFav},
+    {"join", directolor_join},
+    {"remove", directolor_remove},
+    {"duplicate", directolor_duplicate}};
+
+inline int directolorActionFromName(const char *name, uint8_t length) // returns the BlindAction or -1 - name doesn't need to be null terminated
+{
+    for (uint8_t i = 0; i < sizeof(directolorActionNames) / sizeof(directolorActionNames[0]); i++)
+    {
+        const char *candidate = directolorActionNames[i].name;
+        uint8_t j = 0;
+        while (j < length && candidate[j] && ((name[j] ^ candidate[j]) & ~0x20) == 0) // ascii letters only, so ignoring bit 5 ignores case
+            j++;
+        if (j == length && !candidate[j])
+            return directolorActionNames[i].action;
+    }
+    return -1;
+}
+
+inline const char *directolorActionName(uint8_t action)
+{
+    for (uint8_t i = 0; i < sizeof(directolorActionNames) / sizeof(directolorActionNames[0]); i++)
+        if (directolorActionNames[i].action == action)
+            return directolorActionNames[i].name;
+    return "unknown";
+}
+
+#define DIRECTOLOR_FRAME_MARKER 0xC0        // third byte of every frame (after the two remote id bytes) - also the last byte of the capture address
+#define DIRECTOLOR_COMMAND_LENGTH_BASE 0x10 // command frame length byte before any channels are added (one channel = 0x11, two = 0x12, ...)
+
+// Streaming matcher used by remote search mode.  Remotes prefix every command with  [id0] [id1] C0 [length] 00 05  where length is
+// 0x10 + number of channels.  Bytes are fed one at a time, so a frame split across two payloads is still found and a false start
+// (C0 C0 11 00 05) doesn't swallow the real one.
+// It's a shift-and automaton: bit n of state is set when the last n+1 bytes matched the first n+1 pattern elements.
+class DirectolorRemoteMatcher
+{
+public:
+    DirectolorRemoteMatcher() { reset(); }
+
+    void reset()
+    {
+        state = 0;
+        seen = 0;
+        history[0] = history[1] = history[2] = history[3] = history[4] = history[5] = 0;
+    }
+
+    bool push(uint8_t value) // returns true when value completes a frame header
+    {
+        for (uint8_t i = 0; i < sizeof(history) - 1; i++)
+            history[i] = history[i + 1];
+        history[sizeof(history) - 1] = value;
+        if (seen < sizeof(history))
+            seen++;
+
+        state = ((state << 1) | 1) & elementMask(value);
+        return (state & 0x08) && seen == sizeof(history); // need the two id bytes in front of the header too
+    }
+
+    bool feed(const uint8_t *data, uint8_t length) // returns true as soon as a frame header is found (remaining bytes are not consumed)
+    {
+        for (uint8_t i = 0; i < length; i++)
+            if (push(data[i]))
+                return true;
+        return false;
+    }
+
+    uint8_t radioCode(uint8_t index) const { return history[index]; } // the two remote id bytes of the last match (index 0 or 1)
+
+    uint8_t channelCount() const { return history[3] - DIRECTOLOR_COMMAND_LENGTH_BASE; } // how many channels the matched press was sent to
+
+private:
+    uint8_t state;
+    uint8_t seen;
+    uint8_t history[6]; // id0 id1 C0 length 00 05
+
+    static uint8_t elementMask(uint8_t value)
+    {
+        uint8_t mask = 0;
+        if (value == DIRECTOLOR_FRAME_MARKER)
+            mask |= 0x01;
+        if (value > DIRECTOLOR_COMMAND_LENGTH_BASE && value <= DIRECTOLOR_COMMAND_LENGTH_BASE + 6) // 1 to 6 channels
+            mask |= 0x02;
+        if (value == 0x00)
+            mask |= 0x04;
+        if (value == 0x05)
+            mask |= 0x08;
+        return mask;
+    }
+};
+
+// There are a lot of hardcoded values here.  I'm unsure why these ever might need to be different.
+// Here are codes I gathered from my remotes
+// remote 1
+// 12 80 0D 55 FF FF C4 05 B1 EC 1D E3 98 8B C7 52 75 A9 C8 B1 DA
+// 12 80 0D 06 FF FF C4 05 B1 EC 1D E3 98 8B C7 52 75 A9 C8 A4 B1
+// 12 80 0D 02 FF FF C4 05 B1 EC 1D E3 98 8B C7 52 75 A9 C8 68 B3
+
+// remote 2
+// 12 80 0D 85 FF FF BD 55 08 4F 65 60 B0 B0 77 FA 2D FD C8 E2 2E
+// 12 80 0D FF FF FF BD 55 08 4F 65 60 B0 B0 77 FA 2D FD C8 B9 26
+
+// They always send the same value, per remote, and I think it might be some sort of MAC address or something.  Anyway, doesn't appear to need to be different and the generated duplicate codes from these random values seem to work just fine....
+
+static const uint8_t directolorDuplicatePrototype[] = {0XFF, 0XFF, 0xC0, 0X12, 0X80, 0X0D, 0x67, 0XFF, 0XFF, 0XC4, 0X05, 0XB1, 0XEC, 0X1D, 0XE3, 0X98, 0x8B, 0X2D, 0XDE, 0X00, 0XEF, 0XC8}; // 6, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 22, 23
+static const uint8_t directolorGroupPrototype[] = {0X11, 0X11, 0xC0, 0X0A, 0X40, 0X05, 0X18, 0XFF, 0XFF, 0X8A, 0X91, 0X08, 0X03, 0X01};                                        // 0, 1, 6, 9, 10, 12, 13, 14, 15
+// captured as 55 55 55 11 11 C0 0F 00 05 2B FF FF BB 0D 86 04 20 BB 0D 63 49 00 C4 10 AA - training bytes, CRC and trailer stripped.
+// Note there's no channel list - the remote relies on the shades having just been sent a command.
+// Byte 13 (0x20) is sent as captured - with only the one capture there's no telling whether it changes from press to press, and a
+// wrong byte gets the frame rejected.  Fill it in from the nonce only once a second capture shows it varying.
+static const uint8_t directolorStoreFavPrototype[] = {0X11, 0X11, 0xC0, 0x0F, 0x00, 0x05, 0x2B, 0xFF, 0xFF, 0xBB, 0x0D, 0x86, 0x04, 0x20, 0xBB, 0x0D, 0x63, 0x49, 0x00}; // 0, 1, 6, 9, 10, 14, 15
+static const uint8_t directolorCommandPrototype[] = {0X11, 0X11, 0xC0, 0X10, 0X00, 0X05, 0XBC, 0XFF, 0XFF, 0X8A, 0X91, 0X86, 0X06, 0X99, 0X01, 0X00, 0X8A, 0X91, 0X52, 0X53, 0X00};
+
+// The frame builders below fill in payload (at least MAX_PAYLOAD_SIZE bytes) and return the frame length before the CRC.
+// radioCode is the 4 byte remote code and nonce supplies the bytes the remotes send as random values.
+
+inline uint8_t directolorBuildDuplicateFrame(uint8_t *payload, const uint8_t *radioCode, uint16_t nonce)
+{
+    static const uint8_t duplicateBytes[] = {0x06, 0x03, 0x20, 0x05, 0x12, 0x03, 0xAC, 0x56}; // bytes 9 - 16
+    for (uint8_t j = 0; j < sizeof(directolorDuplicatePrototype); j++)
+    {
+        switch (j)
+        {
+        case 6:
+            payload[j] = nonce;
+            break;
+        case 9:
+        case 10:
+        case 11:
+        case 12:
+        case 13:
+        case 14:
+        case 15:
+        case 16:
+            payload[j] = duplicateBytes[j - 9];
+            break;
+        case 17:
+            payload[j] = radioCode[1];
+            break;
+        case 18:
+            payload[j] = radioCode[0];
+            break;
+        case 19:
+            payload[j] = radioCode[2];
+            break;
+        case 20:
+            payload[j] = radioCode[3];
+            break;
+        default:
+            payload[j] = directolorDuplicatePrototype[j];
+            break;
+        }
+    }
+    return sizeof(directolorDuplicatePrototype);
+}
+
+inline uint8_t directolorBuildGroupFrame(uint8_t *payload, const uint8_t *radioCode, uint8_t channels, uint8_t action, uint16_t nonce)
+{
+    for (uint8_t j = 0; j < sizeof(directolorGroupPrototype); j++)
+    {
+        switch (j)
+        {
+        case 0:
+            payload[j] = radioCode[0];
+            break;
+        case 1:
+            payload[j] = radioCode[1];
+            break;
+        case 6:
+            payload[j] = nonce;
+            break;
+        case 9:
+            payload[j] = radioCode[2];
+            break;
+        case 10:
+            payload[j] = radioCode[3];
+            break;
+        case 12: // group frames only carry one channel - the lowest one requested
+            payload[j] = directolorGroupPrototype[j];
+            for (int8_t i = 5; i >= 0; i--)
+                if ((channels >> i) & 1)
+                    payload[j] = i + 1;
+            break;
+        case 13:
+            payload[j] = action;
+            break;
+        default:
+            payload[j] = directolorGroupPrototype[j];
+            break;
+        }
+    }
+    return sizeof(directolorGroupPrototype);
+}
+
+inline uint8_t directolorBuildStoreFavFrame(uint8_t *payload, const uint8_t *radioCode, uint16_t nonce)
+{
+    for (uint8_t j = 0; j < sizeof(directolorStoreFavPrototype); j++)
+    {
+        switch (j)
+        {
+        case 0:
+            payload[j] = radioCode[0];
+            break;
+        case 1:
+            payload[j] = radioCode[1];
+            break;
+        case 6:
+            payload[j] = nonce;
+            break;
+        case 9:
+        case 14:
+            payload[j] = radioCode[2];
+            break;
+        case 10:
+        case 15:
+            payload[j] = radioCode[3];
+            break;
+        default:
+            payload[j] = directolorStoreFavPrototype[j];
+            break;
+        }
+    }
+    return sizeof(directolorStoreFavPrototype);
+}
+
+inline uint8_t directolorBuildCommandFrame(uint8_t *payload, const uint8_t *radioCode, uint8_t channels, uint8_t action, uint16_t nonce)
+{
+    uint8_t length = 0;
+    for (uint8_t j = 0; j < sizeof(directolorCommandPrototype); j++)
+    {
+        switch (j)
+        {
+        case 0:
+            payload[length++] = radioCode[0];
+            break;
+        case 1:
+            payload[length++] = radioCode[1];
+            break;
+        case 6:
+            payload[length++] = nonce;
+            break;
+        case 9:
+        case 16:
+            payload[length++] = radioCode[2];
+            break;
+        case 10:
+        case 17:
+            payload[length++] = radioCode[3];
+            break;
+        case 13:
+            payload[length++] = nonce >> 8;
+            break;
+        case 14: // one byte per channel - each one also bumps the length byte
+            for (uint8_t i = 0; i < 6; i++)
+                if ((channels >> i) & 1)
+                {
+                    payload[length++] = i + 1;
+                    payload[3]++;
+                }
+            break;
+        case 19:
+            payload[length++] = action;
+            break;
+        default:
+            payload[length++] = directolorCommandPrototype[j];
+            break;
+        }
+    }
+    return length;
+}
+
+// took some time to figure this out.  big thanks to CRC RevEng by Gregory Cook!!!!  CRC is calculated over the whole payload, including radio id at start.
+// (CRC-16, poly 0x755B, init 0xFFFF, no reflection, no final xor)
+inline uint16_t directolorCrc16(const uint8_t *data, uint8_t length)
+{
+    uint16_t crc = 0xFFFF;
+    while (length--)
+    {
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x755B : crc << 1;
+    }
+    return crc;
+}
+
+// Right aligns a frame of length bytes in the MAX_PAYLOAD_SIZE payload, padding the front with 0x55 to train the shade receivers.
+inline void directolorPadFrame(uint8_t *payload, uint8_t length)
+{
+    uint8_t padding = MAX_PAYLOAD_SIZE - length;
+    for (int8_t i = length - 1; i >= 0; i--)
+        payload[i + padding] = payload[i];
+    for (uint8_t i = 0; i < padding; i++)
+        payload[i] = 0x55;
+}
+
+// Appends the CRC to a frame of length bytes and pads it out (directolorPadFrame).
+inline void directolorFinishFrame(uint8_t *payload, uint8_t length)
+{
+    uint16_t crc = directolorCrc16(payload, length);
+    payload[length++] = crc >> 8;
+    payload[length++] = crc & 0xFF;
+    directolorPadFrame(payload, length);
+}
+
+// Checks a frame transmitted by directolorFinishFrame / a remote as a shade receiver would: skip the 0x55 training bytes, find the C0 marker
+// behind the remote id and verify the CRC the length byte points at.  Returns the offset of the frame (remote id byte 0) or -1.
+inline int8_t directolorCheckFrame(const uint8_t *payload, uint8_t length)
+{
+    uint8_t start = 0;
+    while (start < length && payload[start] == 0x55)
+        start++;
+    if (start + 4 > length || payload[start + 2] != DIRECTOLOR_FRAME_MARKER)
+        return -1;
+    uint8_t frameLength = payload[start + 3] + 4; // id, id, C0, length byte + body
+    if (start + frameLength + 2 > length)
+        return -1;
+    uint16_t crc = directolorCrc16(payload + start, frameLength);
+    if (payload[start + frameLength] != (crc >> 8) || payload[start + frameLength + 1] != (crc & 0xFF))
+        return -1;
+    return start;
+}
+
+enum DirectolorFrameType
+{
+    directolor_frameUnknown = 0,
+    directolor_frameCommand,
+    directolor_frameGroup,
+    directolor_frameStoreFav,
+    directolor_frameDuplicate
+};
+
+struct DirectolorFrame
+{
+    uint8_t type;         // DirectolorFrameType
+    uint8_t action;       // BlindAction for command and group frames
+    uint8_t channels;     // bit mask - channel 1 = bit 0
+    uint8_t radioCode[2]; // bytes 2 and 3 of the remote code (command, group and store favorite frames)
+};
+
+// Decodes a payload received in capture mode.  The radio has already stripped the 3 address bytes (remote id + C0), so payload[0] is
+// the length byte.  Returns false if the payload is too short for the length it claims or isn't a frame we know.
+inline bool directolorDecodeFrame(const uint8_t *payload, uint8_t length, DirectolorFrame &frame)
+{
+    frame.type = directolor_frameUnknown;
+    frame.action = 0;
+    frame.channels = 0;
+    frame.radioCode[0] = frame.radioCode[1] = 0;
+
+    if (length < 11 || payload[0] + 3 > length) // length byte + body + 2 byte CRC
+        return false;
+
+    if (payload[0] == DUPLICATE_CODE_LENGTH && payload[1] == 0x80) // a two channel command has the same length as a duplicate
+    {
+        frame.type = directolor_frameDuplicate;
+        return true;
+    }
+
+    frame.radioCode[0] = payload[6];
+    frame.radioCode[1] = payload[7];
+
+    if (payload[0] == GROUP_CODE_LENGTH)
+    {
+        frame.type = directolor_frameGroup;
+        if (payload[9] >= 1 && payload[9] <= 6)
+            frame.channels = 1 << (payload[9] - 1);
+        frame.action = payload[10];
+        return true;
+    }
+
+    if (payload[0] == STORE_FAV_CODE_LENGTH)
+    {
+        frame.type = directolor_frameStoreFav;
+        return true;
+    }
+
+    if (payload[0] >= COMMAND_CODE_LENGTH && payload[0] < COMMAND_CODE_LENGTH + 6) // one channel byte per channel, so the action moves along with them
+    {
+        uint8_t channelCount = payload[0] - COMMAND_CODE_LENGTH + 1;
+        for (uint8_t i = 0; i < channelCount; i++)
+            if (payload[11 + i] >= 1 && payload[11 + i] <= 6)
+                frame.channels |= 1 << (payload[11 + i] - 1);
+        frame.type = directolor_frameCommand;
+        frame.action = payload[15 + channelCount];
+        return true;
+    }
+
+    frame.radioCode[0] = frame.radioCode[1] = 0;
+    return false;
+}
+
+// Directolor's command queue - one entry per remote and action, with the remote as an index so an entry packs to 4 bytes.
+struct DirectolorQueueEntry
+{
+    uint8_t remote; // 1 based, 0 for an empty slot
+    uint8_t channels;
+    uint8_t blindAction;
+    uint8_t resendRemainingCount;
+};
+static_assert(sizeof(DirectolorQueueEntry) == 4, "DirectolorQueueEntry should pack to 4 bytes");
+
+typedef void (*DirectolorSupersededHandler)(const DirectolorQueueEntry &entry, uint8_t channels, void *context);
+
+// Queues a command: merged into the entry for the same remote and action if there is one (its attempts start over), and its channels are
+// taken off the remote's entries for other actions - an entry left with no channels is freed.  Join and remove leave the other entries
+// alone.  superseded (optional) is told about each entry that lost channels.  Returns the entry, or 0 if the queue is full.
+inline DirectolorQueueEntry *directolorEnqueue(DirectolorQueueEntry *queue, uint8_t size, uint8_t remote, uint8_t channels, uint8_t action, uint8_t attempts,
+                                               DirectolorSupersededHandler superseded = 0, void *context = 0)
+{
+    DirectolorQueueEntry *queued = 0;
+    for (uint8_t i = 0; i < size; i++)
+    {
+        DirectolorQueueEntry &entry = queue[i];
+        if (entry.remote != remote)
+            continue;
+        if (entry.blindAction == action) // same action - update channels - reset attempts
+        {
+            queued = &entry;
+        }
+        else if ((entry.channels & channels) && action != directolor_join && action != directolor_remove)
+        {
+            uint8_t taken = entry.channels & channels;
+            entry.channels &= ~channels;
+            if (superseded)
+                superseded(entry, taken, context);
+            if (!entry.channels)
+                entry.remote = 0;
+        }
+    }
+
+    for (uint8_t i = 0; i < size && !queued; i++)
+    {
+        if (!queue[i].remote)
+        {
+            queued = &queue[i];
+            queued->remote = remote;
+            queued->channels = 0;
+            queued->blindAction = action;
+        }
+    }
+    if (!queued)
+        return 0;
+
+    queued->channels |= channels;
+    queued->resendRemainingCount = attempts;
+    return queued;
+}
+
+// Capture log - a flat, append-only sequence of fixed size records (little endian, which is what both the ESP32 and a PC are).
+// Every record starts with DIRECTOLOR_CAPTURE_SYNC; nothing printed as text can contain that byte, so a log streamed over Serial
+// alongside the normal output (or truncated by a power cut) can be re-synchronised by scanning for it.
+#define DIRECTOLOR_CAPTURE_SYNC 0xDC
+#define DIRECTOLOR_CAPTURE_SEARCH_MODE 0x80 // flags - record was received in remote search mode (0x55 preamble address, not a remote address)
+#define DIRECTOLOR_CAPTURE_CHANNEL_MASK 0x7F // flags - radio channel the record was received on
+#define DIRECTOLOR_CAPTURE_PIPE_MASK 0x07    // pipe - pipe the payload arrived on
+#define DIRECTOLOR_CAPTURE_STEP_SHIFT 3      // pipe - search mode: low 5 bits of the count of search plan steps taken, so a replay can
+                                             // reset its matcher wherever the device did (a new step can keep the channel and only change the address width)
+
+struct DirectolorCaptureRecord
+{
+    uint8_t sync;       // DIRECTOLOR_CAPTURE_SYNC
+    uint8_t flags;      // DIRECTOLOR_CAPTURE_SEARCH_MODE | radio channel
+    uint8_t pipe;       // search step count << DIRECTOLOR_CAPTURE_STEP_SHIFT | pipe the payload arrived on
+    uint8_t length;     // number of valid bytes in payload
+    uint32_t timestamp; // millis() when the payload was read
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+};
+
+inline bool directolorCaptureRecordValid(const DirectolorCaptureRecord &record)
+{
+    return record.sync == DIRECTOLOR_CAPTURE_SYNC && (record.pipe & DIRECTOLOR_CAPTURE_PIPE_MASK) < 6 && record.length <= MAX_PAYLOAD_SIZE;
+}
+
+#endif
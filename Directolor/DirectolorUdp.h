@@ -0,0 +1,254 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  Project home: https://github.com/sui77/rc-switch/
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+// Binary UDP command protocol - the web example listens for it (ControlUdp) and extras/UdpClient talks it.  Plain C++ like
+// DirectolorProtocol.h so both ends share this file, the controller's handling of a datagram included (directolorUdpReceive).
+//
+// Every datagram starts with a 6 byte header:  'D'  version  type  sequence (2 bytes, little endian)  count
+//
+//   command  client -> controller   count x [remote  channels  action]     remote is 1 based, channels a bit mask, action a BlindAction
+//   ping     client -> controller   count = 0 - answered with an empty ack, nothing is queued (for measuring round trips)
+//   ack      controller -> client   count x [status  position]             one per command, in the order they were sent
+//
+// The ack echoes the sequence number.  position is how many commands were ahead of this one when it was queued - 0 means it is next
+// to go out.  A client that doesn't get an ack resends the same datagram with the same sequence number; the controller remembers
+// recent sequence numbers per client, so a resend is acked again without queueing the commands twice.
+#ifndef _DirectolorUdp_h
+#define _DirectolorUdp_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "DirectolorProtocol.h"
+
+#define DIRECTOLOR_UDP_PORT 2453 // remotes transmit at 2453 mHz
+#define DIRECTOLOR_UDP_MAGIC 'D'
+#define DIRECTOLOR_UDP_VERSION 1
+#define DIRECTOLOR_UDP_HEADER_SIZE 6
+#define DIRECTOLOR_UDP_MAX_COMMANDS 32 // per datagram
+#define DIRECTOLOR_UDP_COMMAND_SIZE 3
+#define DIRECTOLOR_UDP_ACK_ITEM_SIZE 2
+#define DIRECTOLOR_UDP_MAX_REQUEST (DIRECTOLOR_UDP_HEADER_SIZE + DIRECTOLOR_UDP_MAX_COMMANDS * DIRECTOLOR_UDP_COMMAND_SIZE)
+#define DIRECTOLOR_UDP_MAX_ACK (DIRECTOLOR_UDP_HEADER_SIZE + DIRECTOLOR_UDP_MAX_COMMANDS * DIRECTOLOR_UDP_ACK_ITEM_SIZE)
+
+enum DirectolorUdpType
+{
+    directolor_udpCommand = 0x01,
+    directolor_udpPing = 0x02,
+    directolor_udpAck = 0x81
+};
+
+enum DirectolorUdpStatus
+{
+    directolor_udpQueued = 0,
+    directolor_udpBadRemote = 1,
+    directolor_udpBadChannels = 2,
+    directolor_udpBadAction = 3,
+    directolor_udpQueueFull = 4,
+    directolor_udpDuplicate = 5 // a resend of a datagram that was already handled - the command was queued the first time (position unknown)
+};
+
+struct DirectolorUdpHeader
+{
+    uint8_t type;
+    uint16_t sequence;
+    uint8_t count;
+};
+
+inline uint8_t directolorUdpWriteHeader(uint8_t *buffer, uint8_t type, uint16_t sequence, uint8_t count)
+{
+    buffer[0] = DIRECTOLOR_UDP_MAGIC;
+    buffer[1] = DIRECTOLOR_UDP_VERSION;
+    buffer[2] = type;
+    buffer[3] = sequence;
+    buffer[4] = sequence >> 8;
+    buffer[5] = count;
+    return DIRECTOLOR_UDP_HEADER_SIZE;
+}
+
+// Returns false unless the datagram is one of ours and exactly as long as its count says.
+inline bool directolorUdpParseHeader(const uint8_t *buffer, size_t length, DirectolorUdpHeader &header)
+{
+    if (length < DIRECTOLOR_UDP_HEADER_SIZE || buffer[0] != DIRECTOLOR_UDP_MAGIC || buffer[1] != DIRECTOLOR_UDP_VERSION)
+        return false;
+    header.type = buffer[2];
+    header.sequence = buffer[3] | buffer[4] << 8;
+    header.count = buffer[5];
+    if (header.count > DIRECTOLOR_UDP_MAX_COMMANDS)
+        return false;
+
+    size_t itemSize = 0;
+    switch (header.type)
+    {
+    case directolor_udpCommand:
+        itemSize = DIRECTOLOR_UDP_COMMAND_SIZE;
+        break;
+    case directolor_udpAck:
+        itemSize = DIRECTOLOR_UDP_ACK_ITEM_SIZE;
+        break;
+    case directolor_udpPing:
+        break;
+    default:
+        return false;
+    }
+    return length == DIRECTOLOR_UDP_HEADER_SIZE + header.count * itemSize;
+}
+
+inline uint8_t directolorUdpCheckCommand(const uint8_t *command, uint8_t remoteCount, uint8_t channelCount)
+{
+    if (command[0] < 1 || command[0] > remoteCount)
+        return directolor_udpBadRemote;
+    if (!command[1] || command[1] >> channelCount)
+        return directolor_udpBadChannels;
+    for (uint8_t i = 0; i < sizeof(directolorActionNames) / sizeof(directolorActionNames[0]); i++)
+        if (directolorActionNames[i].action == command[2])
+            return directolor_udpQueued;
+    return directolor_udpBadAction;
+}
+
+inline const char *directolorUdpStatusName(uint8_t status)
+{
+    static const char *const names[] = {"queued", "bad remote", "bad channels", "bad action", "queue full", "duplicate"};
+    return status < sizeof(names) / sizeof(names[0]) ? names[status] : "unknown";
+}
+
+// Remembers the last 32 sequence numbers from one client so resends aren't queued twice.  Out of order datagrams inside the window
+// are still accepted once; anything further back than the window is taken as the client having restarted.
+class DirectolorUdpSequenceWindow
+{
+public:
+    enum Result
+    {
+        fresh,         // not seen before - handle it
+        repeatLatest,  // resend of the newest datagram - send the same ack again
+        repeatOlder    // resend of an older one - already handled
+    };
+
+    DirectolorUdpSequenceWindow() : started(false), latest(0), seen(0) {}
+
+    void reset() { started = false; }
+
+    Result check(uint16_t sequence)
+    {
+        int16_t delta = (int16_t)(sequence - latest);
+        if (!started || delta >= 32 || delta <= -32)
+        {
+            started = true;
+            latest = sequence;
+            seen = 1;
+            return fresh;
+        }
+        if (delta > 0)
+        {
+            seen = seen << delta | 1;
+            latest = sequence;
+            return fresh;
+        }
+        if (delta == 0)
+            return repeatLatest;
+
+        uint32_t bit = (uint32_t)1 << -delta;
+        if (seen & bit)
+            return repeatOlder;
+        seen |= bit;
+        return fresh;
+    }
+
+private:
+    bool started;
+    uint16_t latest;
+    uint32_t seen; // bit n set - latest - n has been handled
+};
+
+struct DirectolorUdpPeer // what the controller remembers about one client
+{
+    DirectolorUdpSequenceWindow window;
+    uint8_t lastAck[DIRECTOLOR_UDP_MAX_ACK]; // sent again as is if the newest datagram is resent
+    uint8_t lastAckLength;
+
+    DirectolorUdpPeer() : lastAckLength(0) {}
+
+    void reset()
+    {
+        window.reset();
+        lastAckLength = 0;
+    }
+};
+
+struct DirectolorUdpService
+{
+    uint8_t remotes;                                                                  // remote 1 - remotes are accepted
+    uint8_t channels;                                                                 // channels per remote
+    DirectolorUdpPeer &(*peer)(void *client, void *context);                         // the client a command came from - only asked for commands, so pings don't take a slot
+    bool (*enqueue)(uint8_t remote, uint8_t channels, uint8_t action, void *context); // false if there's no room
+    unsigned (*waiting)(void *context);                                               // commands ahead of the next one queued - the ack's position
+    void *context;
+};
+
+// The controller's side of a datagram - parse it, check it against the client's sequence window, queue its commands and write the
+// ack into reply (DIRECTOLOR_UDP_MAX_ACK bytes).  Returns the reply's length, 0 if there's nothing to send back (not one of ours,
+// or an ack - no reply, so nobody can use the controller to reflect traffic).  client is passed on to service.peer as is.  Plain C++
+// with no sockets, so ControlUdp and extras/UdpClient's loopback server both answer with this.
+inline uint8_t directolorUdpReceive(const uint8_t *datagram, size_t length, void *client, const DirectolorUdpService &service, uint8_t *reply)
+{
+    DirectolorUdpHeader header;
+    if (!directolorUdpParseHeader(datagram, length, header) || header.type == directolor_udpAck)
+        return 0;
+
+    uint8_t replyLength = directolorUdpWriteHeader(reply, directolor_udpAck, header.sequence, header.type == directolor_udpCommand ? header.count : 0);
+    if (header.type == directolor_udpPing)
+        return replyLength;
+
+    DirectolorUdpPeer &peer = service.peer(client, service.context);
+    switch (peer.window.check(header.sequence))
+    {
+    case DirectolorUdpSequenceWindow::repeatLatest:
+        if (peer.lastAckLength)
+        {
+            memcpy(reply, peer.lastAck, peer.lastAckLength);
+            return peer.lastAckLength;
+        }
+        // fall through - the ack wasn't kept, so say it was handled
+    case DirectolorUdpSequenceWindow::repeatOlder:
+        for (uint8_t i = 0; i < header.count; i++)
+        {
+            reply[replyLength++] = directolor_udpDuplicate;
+            reply[replyLength++] = 0;
+        }
+        return replyLength;
+    case DirectolorUdpSequenceWindow::fresh:
+        break;
+    }
+
+    const uint8_t *command = datagram + DIRECTOLOR_UDP_HEADER_SIZE;
+    for (uint8_t i = 0; i < header.count; i++, command += DIRECTOLOR_UDP_COMMAND_SIZE)
+    {
+        uint8_t status = directolorUdpCheckCommand(command, service.remotes, service.channels);
+        unsigned position = service.waiting(service.context);
+        if (status == directolor_udpQueued && !service.enqueue(command[0], command[1], command[2], service.context))
+            status = directolor_udpQueueFull;
+        reply[replyLength++] = status;
+        reply[replyLength++] = status == directolor_udpQueued ? (position < 255 ? position : 255) : 0;
+    }
+
+    memcpy(peer.lastAck, reply, replyLength);
+    peer.lastAckLength = replyLength;
+    return replyLength;
+}
+
+#endif
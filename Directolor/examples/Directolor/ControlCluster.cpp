@@ -0,0 +1,77 @@
+#include "ControlCluster.h"
+
+static_assert(DIRECTOLOR_REMOTE_COUNT <= DIRECTOLOR_CLUSTER_REMOTES, "raise DIRECTOLOR_CLUSTER_REMOTES to cover every remote");
+
+// getEfuseMac() has the vendor prefix (the same on every ESP32) in its low bytes - the id is the rest of the MAC.
+ControlCluster::ControlCluster(Directolor &directolor, uint16_t port) : directolor(directolor), port(port), datagrams(0), cluster((uint32_t)(ESP.getEfuseMac() >> 16), send, enqueue, this), reportedLeader(0), reportedNodes(0)
+{
+}
+
+void ControlCluster::setAffinity(uint8_t remote, uint8_t channels)
+{
+  cluster.setAffinity(remote, channels);
+}
+
+bool ControlCluster::begin(ControlPlane &controlPlane, ControlUdp &controlUdp)
+{
+  WiFi.setSleep(false); // with modem sleep on, broadcasts wait for the access point's DTIM beacon - far too late for slot timing
+  datagrams = xQueueCreate(CONTROL_CLUSTER_DATAGRAM_QUEUE, sizeof(Datagram));
+  if (!udp.listen(port))
+    return false;
+  udp.onPacket([this](AsyncUDPPacket packet) {
+    Datagram datagram;
+    if (packet.length() > sizeof(datagram.data))
+      return;
+    datagram.arrived = millis();
+    datagram.length = packet.length();
+    memcpy(datagram.data, packet.data(), datagram.length);
+    xQueueSend(datagrams, &datagram, 0);
+  });
+
+  controlPlane.setCommandHandler(route, this);
+  controlUdp.setCommandHandler(route, this);
+  Directolor::setTransmitGate(mayTransmit, this);
+  cluster.begin(millis());
+  Serial.print("Cluster node ");
+  Serial.println(cluster.id(), HEX);
+  return true;
+}
+
+void ControlCluster::processLoop()
+{
+  Datagram datagram;
+  while (xQueueReceive(datagrams, &datagram, 0) == pdTRUE)
+    cluster.receive(datagram.data, datagram.length, datagram.arrived);
+  cluster.poll(millis());
+
+  if (cluster.leader() != reportedLeader || cluster.nodeCount() != reportedNodes) // only log changes
+  {
+    reportedLeader = cluster.leader();
+    reportedNodes = cluster.nodeCount();
+    Serial.print("Cluster: ");
+    Serial.print(reportedNodes);
+    Serial.print(" node(s), leader ");
+    Serial.println(reportedLeader, HEX);
+  }
+}
+
+void ControlCluster::send(const uint8_t *data, uint8_t length, void *context)
+{
+  ControlCluster *self = (ControlCluster *)context;
+  self->udp.broadcastTo((uint8_t *)data, length, self->port);
+}
+
+void ControlCluster::enqueue(uint8_t remote, uint8_t channels, uint8_t action, void *context)
+{
+  ((ControlCluster *)context)->directolor.sendMultiChannelCode(remote, channels, (BlindAction)action);
+}
+
+void ControlCluster::route(const ControlCommand &command, void *context)
+{
+  ((ControlCluster *)context)->cluster.route(command.remote, command.channels, command.action, millis());
+}
+
+bool ControlCluster::mayTransmit(uint16_t burstMillis, void *context)
+{
+  return ((ControlCluster *)context)->cluster.mayTransmit(burstMillis, millis());
+}
@@ -0,0 +1,51 @@
+// Lets several controllers share a house (DirectolorCluster.h has how).  Cluster datagrams are broadcast on the LAN; they arrive on
+// the AsyncUDP task and are handed to loop() through a FreeRTOS queue, because the coordinator - like Directolor - only runs on loop().
+//
+// Once begun, commands from the web page, the JSON API and the UDP protocol are routed to the controller that owns each shade, and
+// Directolor only starts a burst inside this controller's transmit slot.
+#ifndef _ControlCluster_h
+#define _ControlCluster_h
+
+#include <WiFi.h>
+#include <AsyncUDP.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "Directolor.h"
+#include "DirectolorCluster.h"
+#include "ControlPlane.h"
+#include "ControlUdp.h"
+
+#define CONTROL_CLUSTER_DATAGRAM_QUEUE 8
+
+class ControlCluster
+{
+public:
+  ControlCluster(Directolor &directolor, uint16_t port = DIRECTOLOR_CLUSTER_PORT);
+
+  void setAffinity(uint8_t remote, uint8_t channels); // channels of this remote that this controller reaches best - before begin()
+  bool begin(ControlPlane &controlPlane, ControlUdp &controlUdp);
+  void processLoop(); // call from loop(), before directolor.processLoop()
+
+private:
+  struct Datagram
+  {
+    uint32_t arrived; // millis() - stamped on the UDP task, so a burst holding up loop() doesn't skew the slot timing
+    uint8_t length;
+    uint8_t data[DIRECTOLOR_CLUSTER_MAX_DATAGRAM];
+  };
+
+  Directolor &directolor;
+  uint16_t port;
+  AsyncUDP udp;
+  QueueHandle_t datagrams;
+  DirectolorCluster cluster;
+  uint32_t reportedLeader;
+  uint8_t reportedNodes;
+
+  static void send(const uint8_t *data, uint8_t length, void *context);
+  static void enqueue(uint8_t remote, uint8_t channels, uint8_t action, void *context);
+  static void route(const ControlCommand &command, void *context);
+  static bool mayTransmit(uint16_t burstMillis, void *context);
+};
+
+#endif
@@ -0,0 +1,82 @@
+// The control plane's coalescing window - commands are held for CONTROL_PLANE_COALESCE_MS before going on, and commands for the same
+// remote and action that arrive inside the window are merged into one channel mask, so a hub firing a request per shade still ends
+// up as one burst per remote.  Plain C++ with no clock - the caller passes the time in and gets the merged commands out through the
+// dispatch handler - so the same code runs in ControlPlane and in extras/CoalesceLoad on a PC.
+//
+// A ControlCoalescer isn't thread safe - ControlPlane only uses it from loop().
+#ifndef _ControlCoalesce_h
+#define _ControlCoalesce_h
+
+#include <stdint.h>
+#include "DirectolorProtocol.h"
+#include "ControlConnection.h"
+
+#define CONTROL_PLANE_COALESCE_MS 8     // how long a command waits for others to merge with (0 turns coalescing off)
+#define CONTROL_PLANE_COALESCE_SLOTS 14 // commands held at once - DIRECTOLOR_MAX_QUEUED_COMMANDS, more wouldn't fit in Directolor's queue
+
+typedef void (*ControlCommandHandler)(const ControlCommand &command, void *context);
+
+class ControlCoalescer
+{
+public:
+  ControlCoalescer(ControlCommandHandler dispatch, void *context, unsigned long windowMillis = CONTROL_PLANE_COALESCE_MS)
+      : dispatch(dispatch), context(context), windowMillis(windowMillis), count(0), since(0) {}
+
+  void add(const ControlCommand &command, unsigned long now)
+  {
+    if (command.action == directolor_join || command.action == directolor_remove || command.action == directolor_duplicate) // group frames only carry one channel - never merge them
+    {
+      flush();
+      dispatch(command, context);
+      return;
+    }
+
+    ControlCommand *merged = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+      if (pending[i].remote != command.remote)
+        continue;
+      if (pending[i].action == command.action)
+        merged = &pending[i];
+      else
+        pending[i].channels &= ~command.channels; // a later command for the same shade wins, as it would in Directolor's queue
+    }
+
+    if (merged)
+      merged->channels |= command.channels;
+    else
+    {
+      if (count == CONTROL_PLANE_COALESCE_SLOTS)
+        flush();
+      if (!count)
+        since = now;
+      pending[count++] = command;
+    }
+  }
+
+  void poll(unsigned long now) // passes the held commands on once the window is over
+  {
+    if (count && now - since >= windowMillis)
+      flush();
+  }
+
+  void flush()
+  {
+    for (uint8_t i = 0; i < count; i++)
+      if (pending[i].channels)
+        dispatch(pending[i], context);
+    count = 0;
+  }
+
+  uint8_t held() const { return count; }
+
+private:
+  ControlCommandHandler dispatch;
+  void *context;
+  unsigned long windowMillis;
+  ControlCommand pending[CONTROL_PLANE_COALESCE_SLOTS];
+  uint8_t count;
+  unsigned long since; // when the first of them arrived
+};
+
+#endif
@@ -0,0 +1,303 @@
+// One HTTP connection of the control plane - buffering the request, answering it and writing the reply out as TCP has room - in
+// plain C++ with no TCP stack and no allocation.  The connection reaches the network through ControlTransport (an AsyncClient in
+// ControlPlane, a socket in extras/ControlBench) and the rest of the controller through ControlService, so the same code answers
+// requests on the ESP32 and in the host benchmark.
+//
+// A ControlConnection isn't thread safe - its owner makes sure only one task drives it (and its client) at a time.
+#ifndef _ControlConnection_h
+#define _ControlConnection_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "DirectolorProtocol.h"
+#include "ControlRequest.h"
+#include "ControlPage.h"
+
+#define CONTROL_PLANE_REQUEST_BUFFER 512  // only the request line and headers are kept, so this just has to hold a long query
+#define CONTROL_PLANE_RESPONSE_BUFFER 320 // status line, headers and JSON bodies
+
+struct ControlCommand
+{
+  uint8_t remote;
+  uint8_t channels;
+  uint8_t action;
+};
+
+struct ControlTransport
+{
+  size_t (*space)(void *client);                                // bytes add() would take right now
+  size_t (*add)(void *client, const char *data, size_t length); // copies data into the send buffer - returns how much it took
+  void (*send)(void *client);                                   // pushes out what has been added
+  void (*close)(void *client);                                  // may free the connection before it returns
+};
+
+struct ControlService
+{
+  uint8_t remotes;                                               // remote 1 - remotes are accepted
+  bool (*enqueue)(const ControlCommand &command, void *context); // false if there's no room
+  unsigned (*waiting)(void *context);                            // commands queued and not handed on yet
+  int (*status)(char *body, size_t size, void *context);         // writes the /api/status body, returns its length
+  void *context;
+};
+
+static const char controlStreamResponse[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-store\r\nConnection: keep-alive\r\n\r\nretry: 2000\n\n";
+static const char controlBusyResponse[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+inline const char *controlStatusText(int status)
+{
+  switch (status)
+  {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 414:
+    return "URI Too Long";
+  }
+  return "Service Unavailable";
+}
+
+class ControlConnection
+{
+public:
+  ControlConnection() : handle(0) {}
+
+  void begin(void *client, const ControlTransport *transport, const ControlService *service) // a new connection (0 - the slot is free)
+  {
+    handle = client;
+    this->transport = transport;
+    this->service = service;
+    requestLength = 0;
+    responding = false;
+    isStreaming = false;
+    responseLength = responseSent = 0;
+    bodyRemaining = 0;
+    inFlight = 0;
+  }
+
+  void *client() const { return handle; }
+  bool streaming() const { return isStreaming; } // an /events stream - stays open for event()
+
+  // Data from the client.  One request per connection - it is answered once the headers are in, anything after it is ignored.
+  void receive(const char *data, size_t length)
+  {
+    if (responding)
+      return;
+
+    size_t room = sizeof(request) - requestLength;
+    if (length > room)
+      length = room;
+    memcpy(request + requestLength, data, length);
+    uint16_t searchFrom = requestLength > 3 ? requestLength - 3 : 0;
+    requestLength += length;
+
+    bool headersDone = false;
+    for (uint16_t i = searchFrom; i + 3 < requestLength && !headersDone; i++)
+      headersDone = !memcmp(request + i, "\r\n\r\n", 4);
+
+    if (headersDone || requestLength == sizeof(request)) // a full buffer is fine as long as the request line is in it
+      respond();
+  }
+
+  void acked(size_t length) // TCP has acked length bytes - more of the reply can go
+  {
+    inFlight -= length < inFlight ? length : inFlight;
+    pump();
+  }
+
+  // Writes what's left of the reply as TCP has room, and closes the connection once it has all been acked.
+  void pump()
+  {
+    if (!responding)
+      return;
+
+    while (responseSent < responseLength)
+    {
+      size_t added = add(response + responseSent, responseLength - responseSent);
+      if (!added)
+        break;
+      responseSent += added;
+    }
+    while (responseSent == responseLength && bodyRemaining)
+    {
+      size_t added = add(body, bodyRemaining);
+      if (!added)
+        break;
+      body += added;
+      bodyRemaining -= added;
+    }
+    transport->send(handle);
+
+    if (responseSent == responseLength && !bodyRemaining && !inFlight && !isStreaming)
+      transport->close(handle); // last - the connection may be gone after this
+  }
+
+  // One event down an /events stream - all of it or none of it, never a partial line.  False if it had to be dropped.
+  bool event(const char *data, size_t length)
+  {
+    if (!isStreaming || responseSent < responseLength || transport->space(handle) < length || transport->add(handle, data, length) != length)
+      return false;
+    inFlight += length;
+    transport->send(handle);
+    return true;
+  }
+
+private:
+  void *handle;
+  const ControlTransport *transport;
+  const ControlService *service;
+  char request[CONTROL_PLANE_REQUEST_BUFFER];
+  uint16_t requestLength;
+  bool responding;
+  bool isStreaming;
+  char response[CONTROL_PLANE_RESPONSE_BUFFER]; // status line, headers and a JSON body - goes out first
+  uint16_t responseLength;
+  uint16_t responseSent;
+  const char *body; // static body still to go out after it
+  uint32_t bodyRemaining;
+  uint32_t inFlight; // bytes handed to TCP and not acked yet
+
+  size_t add(const char *data, uint32_t length) // as much of data as TCP has room for
+  {
+    size_t space = transport->space(handle);
+    size_t added = space ? transport->add(handle, data, space < length ? space : length) : 0;
+    inFlight += added;
+    return added;
+  }
+
+  void respond()
+  {
+    responding = true;
+
+    ControlRequest parsed;
+    if (!controlParseRequest(request, requestLength, parsed))
+    {
+      bool lineComplete = memchr(request, '\n', requestLength) != 0;
+      reply(lineComplete ? 400 : 414, "text/plain", "", 0, false);
+      return;
+    }
+
+    if (controlPathIs(parsed, "/"))
+    {
+      if (parsed.hasAction && parsed.action >= 0 && parsed.remote >= 1 && parsed.remote <= service->remotes && parsed.channels)
+      {
+        ControlCommand command = {(uint8_t)parsed.remote, parsed.channels, (uint8_t)parsed.action};
+        service->enqueue(command, service->context);
+      }
+      reply(200, "text/html", controlPage, sizeof(controlPage) - 1, true);
+    }
+    else if (controlPathIs(parsed, "/api"))
+      respondCommand(parsed.remote, parsed.channels, parsed.hasAction ? parsed.action : -1);
+    else if (controlPathIs(parsed, "/api/batch"))
+      respondBatch(parsed.query, parsed.queryLength);
+    else if (controlPathIs(parsed, "/api/status"))
+    {
+      char body[128];
+      int length = service->status(body, sizeof(body), service->context);
+      reply(200, "application/json", body, length, false);
+    }
+    else if (controlPathIs(parsed, "/events"))
+    {
+      isStreaming = true; // event() holds off until these headers are out
+      memcpy(response, controlStreamResponse, sizeof(controlStreamResponse) - 1);
+      responseLength = sizeof(controlStreamResponse) - 1;
+      pump();
+    }
+    else
+      reply(404, "text/plain", "File Not Found\n", 15, false);
+  }
+
+  void respondCommand(int remote, uint8_t channels, int action)
+  {
+    char body[128];
+    int length;
+    int status = 400;
+
+    if (remote < 1 || remote > service->remotes)
+      length = snprintf(body, sizeof(body), "{\"ok\":false,\"error\":\"remote must be 1 - %d\"}", service->remotes);
+    else if (!channels)
+      length = snprintf(body, sizeof(body), "{\"ok\":false,\"error\":\"bad channel\"}");
+    else if (action < 0)
+      length = snprintf(body, sizeof(body), "{\"ok\":false,\"error\":\"bad action\"}");
+    else
+    {
+      ControlCommand command = {(uint8_t)remote, channels, (uint8_t)action};
+      if (service->enqueue(command, service->context))
+      {
+        status = 200;
+        length = snprintf(body, sizeof(body), "{\"ok\":true,\"remote\":%d,\"channels\":%u,\"action\":\"%s\",\"queued\":%u}", remote, channels, directolorActionName(action), service->waiting(service->context));
+      }
+      else
+      {
+        status = 503;
+        length = snprintf(body, sizeof(body), "{\"ok\":false,\"error\":\"queue full\"}");
+      }
+    }
+    reply(status, "application/json", body, length, false);
+  }
+
+  void respondBatch(const char *query, uint16_t queryLength)
+  {
+    int accepted = 0;
+    int rejected = 0;
+
+    uint16_t position = 0;
+    const char *key, *value;
+    uint16_t keyLength, valueLength;
+    while (controlNextArgument(query, queryLength, position, key, keyLength, value, valueLength))
+    {
+      if (!controlKeyIs(key, keyLength, "cmds"))
+        continue;
+      const char *item = value;
+      const char *end = value + valueLength;
+      while (item < end)
+      {
+        const char *comma = (const char *)memchr(item, ',', end - item);
+        const char *itemEnd = comma ? comma : end;
+
+        int remote, action;
+        uint8_t channels;
+        if (controlParseBatchItem(item, itemEnd - item, remote, channels, action) && remote <= service->remotes)
+        {
+          ControlCommand command = {(uint8_t)remote, channels, (uint8_t)action};
+          if (service->enqueue(command, service->context))
+            accepted++;
+          else
+            rejected++;
+        }
+        else
+          rejected++;
+        item = itemEnd + 1;
+      }
+    }
+
+    char body[96];
+    int length = snprintf(body, sizeof(body), "{\"ok\":%s,\"accepted\":%d,\"rejected\":%d,\"queued\":%u}", rejected || !accepted ? "false" : "true", accepted, rejected, service->waiting(service->context));
+    reply(accepted ? 200 : 400, "application/json", body, length, false);
+  }
+
+  // Dynamic bodies (JSON) are copied in behind the headers; static ones are left where they are and streamed as TCP has room.
+  void reply(int status, const char *contentType, const char *body, uint32_t bodyLength, bool staticBody)
+  {
+    int length = snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n", status, controlStatusText(status), contentType, (unsigned)bodyLength);
+    if (!staticBody) // body is on the caller's stack - it has to be copied now (the buffer is sized for the biggest JSON reply)
+    {
+      if (bodyLength > sizeof(response) - length)
+        bodyLength = sizeof(response) - length;
+      memcpy(response + length, body, bodyLength);
+      length += bodyLength;
+      bodyLength = 0;
+    }
+    responseLength = length;
+    responseSent = 0;
+    this->body = body;
+    bodyRemaining = bodyLength;
+    pump();
+  }
+};
+
+#endif
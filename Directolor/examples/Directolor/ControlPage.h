@@ -0,0 +1,65 @@
+// The web page is static - it lives in flash and is streamed out as is.  Everything that changes (remote list, results) comes from
+// the JSON API by script, so nothing is rendered per request.
+#ifndef _ControlPage_h
+#define _ControlPage_h
+
+#ifndef PROGMEM // not on a PC
+#define PROGMEM
+#endif
+
+static const char controlPage[] PROGMEM = R"page(<html>
+  <head>
+    <title>directolor</title>
+    <style>
+      body { background-color: #cccccc; font-family: Arial, Helvetica, Sans-Serif; Color: #000088; }
+    </style>
+    <meta name="viewport" content="width=device-width, initial-scale=1" />
+  </head>
+  <body>
+    <h1>Welcome to directolor!</h1>
+<form id="form" action="/">
+  <label id="result"></label>
+  <br><br>
+  <label for="remote">Choose remote:</label>
+  <select name="remote" id="remote"></select><br><br>
+  <label>Choose channels:</label>
+  <span id="channels"></span>
+  <br><br>
+  <button type="submit" name="action" value="open">Open</button>
+  <button type="submit" name="action" value="close">Close</button>
+  <button type="submit" name="action" value="tiltOpen">Tilt Open</button>
+  <button type="submit" name="action" value="tiltClose">Tilt Close</button>
+  <br><br>
+  <button type="submit" name="action" value="stop">Stop</button>
+  <button type="submit" name="action" value="toFav">to Favorite</button>
+  <br><br>
+  <button type="submit" name="action" value="join">Join</button>
+  <button type="submit" name="action" value="remove">Remove</button>
+  <button type="submit" name="action" value="setFav">Set Favorite</button>
+  <button type="submit" name="action" value="duplicate">Duplicate</button>
+</form>
+<script>
+const form = document.getElementById('form');
+const args = new URLSearchParams(location.search);
+fetch('/api/status').then(r => r.json()).then(s => {
+  const remote = document.getElementById('remote');
+  for (let i = 1; i <= s.remotes; i++)
+    remote.add(new Option('Remote ' + i, i, false, args.get('remote') == i));
+  let html = '';
+  for (let i = 1; i <= s.channels; i++)
+    html += '<label>   ' + i + ':</label><input type="checkbox" name="c' + i + '"' + (args.has('c' + i) || args.get('channel') == i ? ' checked' : '') + '>';
+  document.getElementById('channels').innerHTML = html;
+});
+form.addEventListener('submit', e => {
+  e.preventDefault();
+  const query = new URLSearchParams(new FormData(form));
+  query.set('action', e.submitter.value);
+  fetch('/api?' + query).then(r => r.json()).then(r => {
+    document.getElementById('result').textContent = r.ok ? r.action + ' remote ' + r.remote + ' channels ' + r.channels + ' (queued ' + r.queued + ')' : 'error: ' + r.error;
+  });
+});
+</script>
+  </body>
+</html>)page";
+
+#endif
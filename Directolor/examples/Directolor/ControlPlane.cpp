@@ -0,0 +1,184 @@
+#include "ControlPlane.h"
+
+static const char keepalive[] = ": keepalive\n\n";
+
+// The AsyncClient side of ControlConnection - only ever called holding slotLock.
+static size_t clientSpace(void *client) { return ((AsyncClient *)client)->space(); }
+static size_t clientAdd(void *client, const char *data, size_t length) { return ((AsyncClient *)client)->add(data, length); }
+static void clientSend(void *client) { ((AsyncClient *)client)->send(); }
+static void clientClose(void *client) { ((AsyncClient *)client)->close(); }
+static const ControlTransport transport = {clientSpace, clientAdd, clientSend, clientClose};
+
+ControlPlane::ControlPlane(Directolor &directolor, uint16_t port) : directolor(directolor), server(port), commands(0), slotLock(0), coalescer(dispatch, this), lastStreamWrite(0), commandHandler(0), commandHandlerContext(0), droppedEvents(0), radioUp(false)
+{
+  service.remotes = DIRECTOLOR_REMOTE_COUNT;
+  service.enqueue = enqueue;
+  service.waiting = waiting;
+  service.status = status;
+  service.context = this;
+}
+
+void ControlPlane::begin()
+{
+  commands = xQueueCreate(CONTROL_PLANE_COMMAND_QUEUE, sizeof(ControlCommand));
+  slotLock = xSemaphoreCreateRecursiveMutex();
+  Directolor::subscribe(onEvent, this);
+  server.onClient([this](void *, AsyncClient *client) { accept(client); }, 0);
+  server.setNoDelay(true);
+  server.begin();
+}
+
+void ControlPlane::lock()
+{
+  xSemaphoreTakeRecursive(slotLock, portMAX_DELAY);
+}
+
+void ControlPlane::unlock()
+{
+  xSemaphoreGiveRecursive(slotLock);
+}
+
+void ControlPlane::processLoop()
+{
+  ControlCommand command;
+  while (xQueueReceive(commands, &command, 0) == pdTRUE)
+    coalescer.add(command, millis());
+  coalescer.poll(millis());
+  if (millis() - lastStreamWrite >= CONTROL_PLANE_KEEPALIVE_MS)
+    broadcast(keepalive, sizeof(keepalive) - 1);
+}
+
+void ControlPlane::onEvent(const DirectolorEvent &event, void *context)
+{
+  char data[192];
+  int length;
+  if (event.type == directolor_eventRadioDown || event.type == directolor_eventRadioUp)
+  {
+    ((ControlPlane *)context)->radioUp = event.type == directolor_eventRadioUp;
+    length = snprintf(data, sizeof(data), "event: %s\ndata: {\"ms\":%lu}\n\n", directolorEventName(event.type), event.millis);
+    ((ControlPlane *)context)->broadcast(data, length);
+    return;
+  }
+
+  length = snprintf(data, sizeof(data), "event: %s\ndata: {\"remote\":%u,\"channels\":%u,\"action\":\"%s\",\"remaining\":%u", directolorEventName(event.type), event.remoteId, event.channels, directolorActionName(event.blindAction), event.attemptsRemaining);
+  if (event.type == directolor_eventRemoteOverheard)
+    length += snprintf(data + length, sizeof(data) - length, ",\"code\":\"%02X%02X%02X%02X\"", event.radioCode[0], event.radioCode[1], event.radioCode[2], event.radioCode[3]);
+  length += snprintf(data + length, sizeof(data) - length, ",\"ms\":%lu}\n\n", event.millis);
+  ((ControlPlane *)context)->broadcast(data, length);
+}
+
+// Runs on loop() - each stream gets the whole event or none of it, never a partial line.
+void ControlPlane::broadcast(const char *data, size_t length)
+{
+  lastStreamWrite = millis();
+  lock();
+  for (int i = 0; i < CONTROL_PLANE_MAX_CLIENTS; i++)
+    if (slots[i].client() && slots[i].streaming() && !slots[i].event(data, length))
+      droppedEvents++;
+  unlock();
+}
+
+void ControlPlane::setCommandHandler(ControlCommandHandler handler, void *context)
+{
+  commandHandler = handler;
+  commandHandlerContext = context;
+}
+
+void ControlPlane::dispatch(const ControlCommand &command, void *context)
+{
+  ControlPlane *plane = (ControlPlane *)context;
+  if (plane->commandHandler)
+    plane->commandHandler(command, plane->commandHandlerContext);
+  else
+    plane->directolor.sendMultiChannelCode(command.remote, command.channels, (BlindAction)command.action);
+}
+
+ControlConnection *ControlPlane::slotFor(AsyncClient *client)
+{
+  for (int i = 0; i < CONTROL_PLANE_MAX_CLIENTS; i++)
+    if (slots[i].client() == client)
+      return &slots[i];
+  return 0;
+}
+
+// The handlers below run on the AsyncTCP task.
+void ControlPlane::accept(AsyncClient *client)
+{
+  lock();
+  ControlConnection *slot = slotFor(0);
+  if (slot)
+    slot->begin(client, &transport, &service);
+  unlock();
+  if (!slot)
+  {
+    client->onDisconnect([](void *, AsyncClient *client) { delete client; }, 0);
+    client->add(controlBusyResponse, sizeof(controlBusyResponse) - 1);
+    client->send();
+    client->close();
+    return;
+  }
+
+  client->setRxTimeout(5);
+  client->onData([this](void *, AsyncClient *client, void *data, size_t length) {
+    lock();
+    ControlConnection *slot = slotFor(client);
+    if (slot)
+    {
+      slot->receive((const char *)data, length);
+      if (slot->client() == client && slot->streaming())
+        client->setRxTimeout(0); // a stream is quiet in the other direction for as long as it's open
+    }
+    unlock();
+  }, 0);
+  client->onAck([this](void *, AsyncClient *client, size_t length, uint32_t) {
+    lock();
+    ControlConnection *slot = slotFor(client);
+    if (slot)
+      slot->acked(length);
+    unlock();
+  }, 0);
+  client->onPoll([this](void *, AsyncClient *client) {
+    lock();
+    ControlConnection *slot = slotFor(client);
+    if (slot)
+      slot->pump();
+    unlock();
+  }, 0);
+  client->onTimeout([this](void *, AsyncClient *client, uint32_t) {
+    lock();
+    client->close();
+    unlock();
+  }, 0);
+  client->onError([this](void *, AsyncClient *client, int8_t) {
+    lock();
+    client->close();
+    unlock();
+  }, 0);
+  client->onDisconnect([this](void *, AsyncClient *client) {
+    lock();
+    ControlConnection *slot = slotFor(client);
+    if (slot)
+      slot->begin(0, &transport, &service);
+    unlock();
+    delete client;
+  }, 0);
+}
+
+bool ControlPlane::enqueue(const ControlCommand &command, void *context)
+{
+  return xQueueSend(((ControlPlane *)context)->commands, &command, 0) == pdTRUE;
+}
+
+unsigned ControlPlane::waiting(void *context)
+{
+  return uxQueueMessagesWaiting(((ControlPlane *)context)->commands);
+}
+
+int ControlPlane::status(char *body, size_t size, void *context)
+{
+  ControlPlane *plane = (ControlPlane *)context;
+  int streams = 0;
+  for (int i = 0; i < CONTROL_PLANE_MAX_CLIENTS; i++)
+    streams += plane->slots[i].client() && plane->slots[i].streaming();
+  return snprintf(body, size, "{\"remotes\":%d,\"channels\":%d,\"pending\":%u,\"streams\":%d,\"dropped\":%u,\"radio\":\"%s\"}", DIRECTOLOR_REMOTE_COUNT, DIRECTOLOR_REMOTE_CHANNELS, (unsigned)uxQueueMessagesWaiting(plane->commands), streams, (unsigned)plane->droppedEvents, plane->radioUp ? "up" : "down");
+}
@@ -0,0 +1,75 @@
+// Event driven HTTP control plane on AsyncTCP.
+//
+// Requests are parsed and answered inside the AsyncTCP task, so a slow client never holds up loop() and the radio.  Commands are
+// handed to loop() through a FreeRTOS queue - Directolor itself is only ever touched from loop().  Each connection's request and
+// reply is a ControlConnection (ControlConnection.h), which is plain C++ and is benchmarked on a PC by extras/ControlBench.
+//
+//   GET /                            the control page (static, streamed from flash)
+//   GET /?remote=1&channel=2&action=open   same page, and queues the command (what the Hubitat driver and old bookmarks use)
+//   GET /api?remote=1&channels=5&action=close   queue a command, JSON reply
+//   GET /api/batch?cmds=1.3.open,1.4.open,2.135.close   queue many commands at once (remote.channels.action - see ControlRequest.h)
+//   GET /api/status                  JSON - number of remotes / channels and commands waiting to be handed to Directolor
+//   GET /events                      server-sent events - every Directolor event (enqueued, superseded, transmitted, completed,
+//                                    remoteOverheard) as it happens, so a hub can follow the queue instead of polling
+//
+// Commands are held for CONTROL_PLANE_COALESCE_MS before going to Directolor, and commands for the same remote and action that arrive
+// inside that window are merged into one channel mask - so a hub firing a request per shade still ends up as one burst per remote.
+// The window is a ControlCoalescer (ControlCoalesce.h), load tested on a PC by extras/CoalesceLoad.
+//
+// Events are written to the streams from loop() (that's where Directolor raises them), while everything else is written from the
+// AsyncTCP task - so every use of a slot or its AsyncClient (add, send, close, the in flight count) is made holding slotLock.  It is
+// recursive, because AsyncClient::close() calls the disconnect handler before it returns.  A stream that can't take an event right
+// away misses it rather than holding up the radio - the "dropped" count in /api/status says if that is happening.
+#ifndef _ControlPlane_h
+#define _ControlPlane_h
+
+#include <AsyncTCP.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "Directolor.h"
+#include "ControlConnection.h"
+#include "ControlCoalesce.h"
+
+#define CONTROL_PLANE_MAX_CLIENTS 6       // connections served at once, event streams included - more get a 503
+#define CONTROL_PLANE_COMMAND_QUEUE 32    // commands waiting for loop()
+#define CONTROL_PLANE_KEEPALIVE_MS 15000  // comment line sent down idle event streams so proxies and hubs don't time them out
+
+static_assert(CONTROL_PLANE_COALESCE_SLOTS >= DIRECTOLOR_MAX_QUEUED_COMMANDS, "CONTROL_PLANE_COALESCE_SLOTS should cover Directolor's queue");
+
+class ControlPlane
+{
+public:
+  ControlPlane(Directolor &directolor, uint16_t port = 80);
+
+  void begin();
+  void processLoop(); // call from loop() - passes queued commands on to Directolor
+  void setCommandHandler(ControlCommandHandler handler, void *context); // commands go to handler (on loop()) instead of straight to Directolor - 0 to undo
+
+private:
+  Directolor &directolor;
+  AsyncServer server;
+  QueueHandle_t commands;
+  SemaphoreHandle_t slotLock; // recursive - held for every use of a slot and its client, from either task
+  ControlConnection slots[CONTROL_PLANE_MAX_CLIENTS];
+  ControlService service;
+  ControlCoalescer coalescer; // only touched from loop()
+  unsigned long lastStreamWrite;
+  ControlCommandHandler commandHandler;
+  void *commandHandlerContext;
+  uint32_t droppedEvents;
+  volatile bool radioUp; // from the radioUp / radioDown events - read by /api/status on the AsyncTCP task
+
+  void accept(AsyncClient *client);
+  void broadcast(const char *data, size_t length);
+  void lock();
+  void unlock();
+  static void onEvent(const DirectolorEvent &event, void *context);
+  static void dispatch(const ControlCommand &command, void *context);
+  static bool enqueue(const ControlCommand &command, void *context);
+  static unsigned waiting(void *context);
+  static int status(char *body, size_t size, void *context);
+  ControlConnection *slotFor(AsyncClient *client);
+};
+
+#endif
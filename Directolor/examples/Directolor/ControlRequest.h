@@ -0,0 +1,162 @@
+// Request parsing for the control plane.  Plain C++ with no allocation - everything points back into the caller's buffer - so it
+// runs inside the TCP callback and can be built on a PC.
+#ifndef _ControlRequest_h
+#define _ControlRequest_h
+
+#include <stdint.h>
+#include <string.h>
+#include "DirectolorProtocol.h"
+
+#define CONTROL_REMOTE_CHANNELS 6
+
+struct ControlRequest
+{
+  const char *path; // not null terminated
+  uint16_t pathLength;
+  const char *query; // everything after '?', not null terminated
+  uint16_t queryLength;
+  int remote;       // 1 if not given
+  uint8_t channels; // bit mask - channel 1 = bit 0, 1 if not given
+  int action;       // BlindAction, -1 if not given or unknown
+  bool hasAction;   // an action parameter was present (even if it wasn't one we know)
+};
+
+inline bool controlPathIs(const ControlRequest &request, const char *path)
+{
+  return request.pathLength == strlen(path) && !memcmp(request.path, path, request.pathLength);
+}
+
+inline int controlParseNumber(const char *value, uint16_t length)
+{
+  int number = 0;
+  for (uint16_t i = 0; i < length && i < 5; i++)
+  {
+    if (value[i] < '0' || value[i] > '9')
+      return -1;
+    number = number * 10 + value[i] - '0';
+  }
+  return length ? number : -1;
+}
+
+inline bool controlKeyIs(const char *key, uint16_t keyLength, const char *name)
+{
+  return keyLength == strlen(name) && !memcmp(key, name, keyLength);
+}
+
+// Steps through key=value pairs of a query string - position starts at 0, returns false when there are no more.
+inline bool controlNextArgument(const char *query, uint16_t length, uint16_t &position, const char *&key, uint16_t &keyLength, const char *&value, uint16_t &valueLength)
+{
+  if (position >= length)
+    return false;
+  key = query + position;
+  keyLength = 0;
+  while (position < length && query[position] != '=' && query[position] != '&')
+    position++, keyLength++;
+  value = query + position;
+  valueLength = 0;
+  if (position < length && query[position] == '=')
+  {
+    value = query + ++position;
+    while (position < length && query[position] != '&')
+      position++, valueLength++;
+  }
+  position++; // skip '&'
+  return true;
+}
+
+// Parses the query arguments the old WebServer page took: remote, action, channel (1-6), channels (bit mask) or c1..c6 checkboxes.
+inline void controlParseQuery(const char *query, uint16_t length, ControlRequest &request)
+{
+  uint8_t checkboxes = 0;
+  int channel = -1;
+  int channels = -1;
+
+  uint16_t position = 0;
+  const char *key, *value;
+  uint16_t keyLength, valueLength;
+  while (controlNextArgument(query, length, position, key, keyLength, value, valueLength))
+  {
+    if (controlKeyIs(key, keyLength, "remote"))
+      request.remote = controlParseNumber(value, valueLength);
+    else if (controlKeyIs(key, keyLength, "action"))
+    {
+      request.hasAction = true;
+      request.action = directolorActionFromName(value, valueLength);
+    }
+    else if (controlKeyIs(key, keyLength, "channel"))
+      channel = controlParseNumber(value, valueLength);
+    else if (controlKeyIs(key, keyLength, "channels"))
+      channels = controlParseNumber(value, valueLength);
+    else if (keyLength == 2 && key[0] == 'c' && key[1] >= '1' && key[1] < '1' + CONTROL_REMOTE_CHANNELS)
+      checkboxes |= 1 << (key[1] - '1');
+  }
+
+  if (channel >= 1 && channel <= CONTROL_REMOTE_CHANNELS)
+    request.channels = 1 << (channel - 1);
+  else if (channel != -1)
+    request.channels = 0; // out of range - rejected by the caller
+  else if (channels != -1)
+    request.channels = channels < (1 << CONTROL_REMOTE_CHANNELS) ? channels : 0;
+  else if (checkboxes)
+    request.channels = checkboxes;
+}
+
+// One batch item -  remote.channels.action  where channels are the channel digits, so 2.135.close closes channels 1, 3 and 5 of
+// remote 2.  Items are comma separated in cmds= (cmds can be repeated).  Returns false if the item doesn't parse.
+inline bool controlParseBatchItem(const char *item, uint16_t length, int &remote, uint8_t &channels, int &action)
+{
+  const char *firstDot = (const char *)memchr(item, '.', length);
+  if (!firstDot)
+    return false;
+  const char *secondDot = (const char *)memchr(firstDot + 1, '.', item + length - firstDot - 1);
+  if (!secondDot)
+    return false;
+
+  remote = controlParseNumber(item, firstDot - item);
+  channels = 0;
+  for (const char *c = firstDot + 1; c < secondDot; c++)
+  {
+    if (*c < '1' || *c >= '1' + CONTROL_REMOTE_CHANNELS)
+      return false;
+    channels |= 1 << (*c - '1');
+  }
+  action = directolorActionFromName(secondDot + 1, item + length - secondDot - 1);
+  return remote >= 1 && channels && action >= 0;
+}
+
+// Parses "GET /path?query HTTP/1.1" at the start of buffer.  Returns false if the request line isn't complete or isn't a GET.
+inline bool controlParseRequest(const char *buffer, uint16_t length, ControlRequest &request)
+{
+  request.path = 0;
+  request.pathLength = 0;
+  request.query = 0;
+  request.queryLength = 0;
+  request.remote = 1;
+  request.channels = 1;
+  request.action = -1;
+  request.hasAction = false;
+
+  if (length < 6 || memcmp(buffer, "GET /", 5))
+    return false;
+
+  uint16_t position = 4;
+  request.path = buffer + position;
+  while (position < length && buffer[position] != ' ' && buffer[position] != '?' && buffer[position] != '\r')
+    position++;
+  request.pathLength = buffer + position - request.path;
+
+  if (position < length && buffer[position] == '?')
+  {
+    request.query = buffer + ++position;
+    while (position < length && buffer[position] != ' ' && buffer[position] != '\r')
+      position++;
+    request.queryLength = buffer + position - request.query;
+  }
+  if (position >= length || buffer[position] != ' ')
+    return false;
+
+  controlParseQuery(request.query, request.queryLength, request);
+  return true;
+}
+
+#endif
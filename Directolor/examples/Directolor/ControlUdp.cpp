@@ -0,0 +1,91 @@
+#include "ControlUdp.h"
+
+ControlUdp::ControlUdp(Directolor &directolor, uint16_t port) : directolor(directolor), port(port), commands(0), commandHandler(0), commandHandlerContext(0), directolorQueued(0)
+{
+  for (int i = 0; i < CONTROL_UDP_PEERS; i++)
+  {
+    peers[i].address = 0;
+    peers[i].port = 0;
+    peers[i].lastHeard = 0;
+  }
+  service.remotes = DIRECTOLOR_REMOTE_COUNT;
+  service.channels = DIRECTOLOR_REMOTE_CHANNELS;
+  service.peer = peerFor;
+  service.enqueue = enqueue;
+  service.waiting = waiting;
+  service.context = this;
+}
+
+bool ControlUdp::begin()
+{
+  commands = xQueueCreate(CONTROL_UDP_COMMAND_QUEUE, sizeof(ControlCommand));
+  if (!udp.listen(port))
+    return false;
+  udp.onPacket([this](AsyncUDPPacket packet) { receive(packet); });
+  return true;
+}
+
+void ControlUdp::processLoop()
+{
+  ControlCommand command;
+  while (xQueueReceive(commands, &command, 0) == pdTRUE)
+  {
+    if (commandHandler)
+      commandHandler(command, commandHandlerContext);
+    else
+      directolor.sendMultiChannelCode(command.remote, command.channels, (BlindAction)command.action);
+  }
+  directolorQueued = Directolor::queuedCommandCount();
+}
+
+void ControlUdp::setCommandHandler(ControlCommandHandler handler, void *context)
+{
+  commandHandler = handler;
+  commandHandlerContext = context;
+}
+
+DirectolorUdpPeer &ControlUdp::peerFor(void *client, void *context)
+{
+  ControlUdp *udp = (ControlUdp *)context;
+  AsyncUDPPacket &packet = *(AsyncUDPPacket *)client;
+  uint32_t address = packet.remoteIP();
+  uint16_t port = packet.remotePort();
+
+  Peer *oldest = &udp->peers[0];
+  for (int i = 0; i < CONTROL_UDP_PEERS; i++)
+  {
+    if (udp->peers[i].address == address && udp->peers[i].port == port)
+    {
+      udp->peers[i].lastHeard = millis();
+      return udp->peers[i].state;
+    }
+    if (millis() - udp->peers[i].lastHeard > millis() - oldest->lastHeard)
+      oldest = &udp->peers[i];
+  }
+  oldest->address = address;
+  oldest->port = port;
+  oldest->lastHeard = millis();
+  oldest->state.reset();
+  return oldest->state;
+}
+
+bool ControlUdp::enqueue(uint8_t remote, uint8_t channels, uint8_t action, void *context)
+{
+  ControlCommand command = {remote, channels, action};
+  return xQueueSend(((ControlUdp *)context)->commands, &command, 0) == pdTRUE;
+}
+
+unsigned ControlUdp::waiting(void *context)
+{
+  ControlUdp *udp = (ControlUdp *)context;
+  return udp->directolorQueued + uxQueueMessagesWaiting(udp->commands);
+}
+
+// Runs on the AsyncUDP task.
+void ControlUdp::receive(AsyncUDPPacket &packet)
+{
+  uint8_t reply[DIRECTOLOR_UDP_MAX_ACK];
+  uint8_t length = directolorUdpReceive(packet.data(), packet.length(), &packet, service, reply);
+  if (length)
+    packet.write(reply, length);
+}
@@ -0,0 +1,56 @@
+// Binary UDP command listener (protocol in DirectolorUdp.h) - the low latency path for automation servers.  There is no connection
+// to set up and nothing to parse but a few bytes, and the ack goes back straight from the UDP task, so a command costs one datagram
+// each way.
+//
+// Like ControlPlane, commands are handed to loop() through a FreeRTOS queue.  They skip the coalescing window - a client that wants
+// several shades moved together sends them in one datagram.
+#ifndef _ControlUdp_h
+#define _ControlUdp_h
+
+#include <AsyncUDP.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "Directolor.h"
+#include "DirectolorUdp.h"
+#include "ControlPlane.h"
+
+#define CONTROL_UDP_COMMAND_QUEUE 64 // commands waiting for loop() - two full datagrams
+#define CONTROL_UDP_PEERS 4          // clients whose recent sequence numbers are remembered (least recently heard from is replaced)
+
+class ControlUdp
+{
+public:
+  ControlUdp(Directolor &directolor, uint16_t port = DIRECTOLOR_UDP_PORT);
+
+  bool begin();
+  void processLoop(); // call from loop() - passes queued commands on to Directolor
+  void setCommandHandler(ControlCommandHandler handler, void *context); // as ControlPlane::setCommandHandler
+
+private:
+  struct Peer
+  {
+    uint32_t address;
+    uint16_t port;
+    unsigned long lastHeard;
+    DirectolorUdpPeer state;
+  };
+
+  Directolor &directolor;
+  uint16_t port;
+  AsyncUDP udp;
+  QueueHandle_t commands;
+  Peer peers[CONTROL_UDP_PEERS];  // only touched from the UDP task
+  DirectolorUdpService service;
+  ControlCommandHandler commandHandler;
+  void *commandHandlerContext;
+  volatile uint8_t directolorQueued; // Directolor's queue depth as of the last processLoop() - used for ack positions
+
+  void receive(AsyncUDPPacket &packet);
+
+  // DirectolorUdpService - client is the AsyncUDPPacket
+  static DirectolorUdpPeer &peerFor(void *client, void *context);
+  static bool enqueue(uint8_t remote, uint8_t channels, uint8_t action, void *context);
+  static unsigned waiting(void *context);
+};
+
+#endif
@@ -2,8 +2,8 @@
    Run this and monitor the serial output.
    You will need to connect a NRF24L01+ via the SPI on pins 22 & 21 - you'll need more connected.
    Follow the NRF24L01+ instructions for connecting.
-   When it runs it will enter search mode.  Choose a single channel on your remote - press the open button
-   You may need to press it a few times to get it found
+   When it runs it will enter search mode.  Choose a channel (or several) on your remote - press the open button
+   Search hops through DIRECTOLOR_SEARCH_CHANNELS / DIRECTOLOR_SEARCH_ADDRESS_WIDTHS, so you may need to hold or repeat the press for a second or two
    Once you have found it, then just press keys until you've pressed the keys 3 times each.  Do this for each channel as well as join, remove and set favorite.
 
    Then press 'd' to "dump" the codes - this will be in the correct format to add to the Directolor library - don't forget to change the Maximum remotes, if needed.
@@ -16,6 +16,7 @@
 
 int remote = 1;
 int channel = 1;
+bool captureLogging = false;
 
 char serial_command_buffer_[32];
 SerialCommands serial_commands_(&Serial, serial_command_buffer_, sizeof(serial_command_buffer_), "\n", " ");
@@ -42,6 +43,11 @@ void cmd_stop(SerialCommands* sender)
   directolor.sendCode(remote, channel, directolor_stop);
 }
 
+void cmd_setFav(SerialCommands* sender)
+{
+  directolor.sendCode(remote, channel, directolor_setFav);
+}
+
 void cmd_join(SerialCommands* sender)
 {
   directolor.sendCode(remote, channel, directolor_join);
@@ -58,6 +64,12 @@ void cmd_remoteSearchMode(SerialCommands* sender)
     Serial.println("Unable to enter remote capture mode...");
 }
 
+void cmd_captureLog(SerialCommands* sender)
+{
+  captureLogging = !captureLogging;
+  directolor.setCaptureLog(captureLogging ? &Serial : 0);  // binary records are mixed in with the text - extras/CaptureReplay skips the text
+}
+
 void cmd_updateRemote(SerialCommands* sender)
 {
   char* value = sender->Next();
@@ -107,8 +119,10 @@ void cmd_help(SerialCommands* sender)
                  "(o)pen blind    - send open code for current channel(s)\r\n"\
                  "(c)lose blind   - send close code for current channel(s)\r\n"\
                  "(s)top blind    - send stop code for current channel(s)\r\n"\
+                 "(f)avorite      - store the blind's current position as its favorite\r\n"\
                  "(j)oin blind    - send join code for current channel\r\n"\
                  "(r)emove blind  - send remove code for current channel\r\n"\
+                 "(log) capture   - toggle streaming received payloads to serial as binary capture records (see extras/CaptureReplay)\r\n"\
                  "(remote #)      - set remote number\r\n"\
                  "(channel #)     - set channel number\r\n"\
                  "(help)          - show this screen\r\n"\
@@ -131,9 +145,11 @@ SerialCommand cmd_dump_("dump", cmd_dump);
 SerialCommand cmd_close_("c", cmd_close);
 SerialCommand cmd_open_("o", cmd_open);
 SerialCommand cmd_stop_("s", cmd_stop);
+SerialCommand cmd_setFav_("f", cmd_setFav);
 SerialCommand cmd_join_("j", cmd_join);
 SerialCommand cmd_remove_("r", cmd_remove);
 SerialCommand cmd_remoteSearchMode_("search", cmd_remoteSearchMode);
+SerialCommand cmd_captureLog_("log", cmd_captureLog);
 SerialCommand cmd_updateRemote_("remote", cmd_updateRemote);
 SerialCommand cmd_updateChannel_("channel", cmd_updateChannel);
 SerialCommand cmd_help_("help", cmd_help);
@@ -146,9 +162,11 @@ void setup() {
   serial_commands_.AddCommand(&cmd_close_);
   serial_commands_.AddCommand(&cmd_open_);
   serial_commands_.AddCommand(&cmd_stop_);
+  serial_commands_.AddCommand(&cmd_setFav_);
   serial_commands_.AddCommand(&cmd_join_);
   serial_commands_.AddCommand(&cmd_remove_);
   serial_commands_.AddCommand(&cmd_remoteSearchMode_);
+  serial_commands_.AddCommand(&cmd_captureLog_);
   serial_commands_.AddCommand(&cmd_updateRemote_);
   serial_commands_.AddCommand(&cmd_updateChannel_);
   serial_commands_.AddCommand(&cmd_help_);
@@ -0,0 +1,80 @@
+/**
+   A battery (or solar) controller - no WiFi, just a button.  Each press moves remote 1, channel 1 the other way (open / close).
+
+   Between bursts the ESP32 light sleeps with the radio powered down; once the queue is empty it deep sleeps until the button is
+   pressed again.  If the radio stops answering, the commands stay queued while Directolor backs off between start attempts - once
+   that wait is a second or more it deep sleeps through it too, timer and button both armed.  Deep sleep is a reboot - resume() puts
+   Directolor back as it was (queue, radio and its backoff) before anything else in setup().
+
+   Wire the button between WAKE_PIN and ground (it has to be an RTC GPIO to wake from deep sleep - 0, 2, 4, 12-15, 25-27, 32-39).
+   The NRF24L01+ is on pins 22 & 21, as in the other examples.
+
+   After each round it prints the time spent in each power state, the wake latency (wake to start of the first burst) and the
+   estimated charge used - change the DIRECTOLOR_UA_* figures in Directolor.h to match your boards.
+*/
+
+#include "Directolor.h"
+
+#define WAKE_PIN 33
+
+RTC_DATA_ATTR bool shadeOpen = false;
+
+Directolor directolor(22, 21);
+
+void printPowerStats()
+{
+  DirectolorPowerStats stats = directolor.powerStats();
+  Serial.print("awake ");
+  Serial.print(stats.awakeMillis);
+  Serial.print("ms, light sleep ");
+  Serial.print(stats.lightSleepMillis);
+  Serial.print("ms, deep sleep ");
+  Serial.print(stats.deepSleepMillis);
+  Serial.print("ms, radio tx ");
+  Serial.print(stats.radioTxMillis);
+  Serial.print("ms, listen ");
+  Serial.print(stats.radioListenMillis);
+  Serial.println("ms");
+  Serial.print("wake latency ");
+  Serial.print(stats.wakeLatencyMicros);
+  Serial.print("us (max ");
+  Serial.print(stats.wakeLatencyMaxMicros);
+  Serial.print("us, average ");
+  Serial.print(stats.wakes ? stats.wakeLatencyTotalMicros / stats.wakes : 0);
+  Serial.print("us over ");
+  Serial.print(stats.wakes);
+  Serial.print(" wakes), ");
+  Serial.print(directolorPowerMilliampHours(stats), 4);
+  Serial.println("mAh");
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  bool resumed = directolor.resume(); // before anything slow - the queue is waiting
+  Directolor::setLowPower(true);
+
+  pinMode(WAKE_PIN, INPUT_PULLUP);
+  if (!resumed || esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0)
+  {
+    if (resumed) // woken by the button, not by a pending burst
+    {
+      shadeOpen = !shadeOpen;
+      directolor.sendCode(1, 1, shadeOpen ? directolor_open : directolor_close);
+    }
+    while (digitalRead(WAKE_PIN) == LOW) // wait for the button to be let go, or it wakes us straight back up
+      directolor.processLoop();
+  }
+}
+
+void loop()
+{
+  directolor.processLoop();
+
+  unsigned long idle = Directolor::idleMillis();
+  if (idle == DIRECTOLOR_IDLE_FOREVER)
+    printPowerStats();
+  if (idle >= DIRECTOLOR_MIN_DEEP_SLEEP_MS)
+    directolor.sleep(DIRECTOLOR_IDLE_FOREVER, WAKE_PIN, true); // until the button is pressed - or with the radio missing, its next start attempt
+  directolor.sleep(); // light sleep until the next burst is due
+}
@@ -0,0 +1,95 @@
+/**
+   Times the hot paths of sending and receiving (MicrobenchKernels.h) on the ESP32 - frame encoding, the CRC, padding, frame checks,
+   decoding, the remote search matcher and the command queue.  No radio or WiFi is needed.
+
+   Each kernel runs in samples of about SAMPLE_MS and the fastest of SAMPLES is printed as ns/op and cycles/op (the CPU cycle counter,
+   so it doesn't depend on the clock speed the board was built for).  At the end the results are printed as JSON between two marker
+   lines - save that part of the serial log and compare it with an earlier one on a PC:
+
+     extras/Microbench/Microbench --compare before.json after.json [--threshold 25]
+
+   Send any character over serial to run it again.
+*/
+
+#include "DirectolorProtocol.h"
+#include "MicrobenchKernels.h"
+
+#define SAMPLE_MS 100
+#define SAMPLES 5
+
+volatile uint32_t sink; // checksums end up here, so the kernels' work is used
+
+struct Result
+{
+  float ns;
+  float cycles;
+};
+
+Result results[MICROBENCH_KERNEL_COUNT];
+
+Result timeKernel(const MicrobenchKernel &kernel)
+{
+  uint32_t iterations = 16;
+  for (;;) // find how many iterations take about SAMPLE_MS
+  {
+    uint32_t start = micros();
+    sink += kernel.run(iterations);
+    uint32_t elapsed = micros() - start;
+    if (elapsed >= SAMPLE_MS * 250UL || iterations >= 0x1000000)
+    {
+      iterations = max((uint64_t)1, (uint64_t)iterations * SAMPLE_MS * 1000 / max(elapsed, (uint32_t)1));
+      break;
+    }
+    iterations *= 4;
+  }
+
+  Result fastest = {0, 0};
+  for (uint8_t i = 0; i < SAMPLES; i++)
+  {
+    yield(); // let the idle task feed the watchdog between samples
+    uint32_t startCycles = ESP.getCycleCount();
+    uint32_t start = micros();
+    sink += kernel.run(iterations);
+    uint32_t elapsed = micros() - start;
+    uint32_t cycles = ESP.getCycleCount() - startCycles; // wraps after ~17s at 240MHz - samples are far shorter
+    Result sample = {elapsed * 1000.0f / iterations, (float)cycles / iterations};
+    if (i == 0 || sample.cycles < fastest.cycles)
+      fastest = sample;
+  }
+  return fastest;
+}
+
+void runAll()
+{
+  Serial.printf("%-16s %10s %10s\n", "kernel", "ns/op", "cycles/op");
+  for (uint8_t i = 0; i < MICROBENCH_KERNEL_COUNT; i++)
+  {
+    results[i] = timeKernel(microbenchKernels[i]);
+    Serial.printf("%-16s %10.2f %10.2f\n", microbenchKernels[i].name, results[i].ns, results[i].cycles);
+  }
+
+  Serial.println("----- microbench json -----");
+  Serial.print("{\"platform\":\"esp32\",\"kernels\":{");
+  for (uint8_t i = 0; i < MICROBENCH_KERNEL_COUNT; i++)
+    Serial.printf("%s\n  \"%s\":{\"ns\":%.3f,\"cycles\":%.2f}", i ? "," : "", microbenchKernels[i].name, results[i].ns, results[i].cycles);
+  Serial.println("\n}}");
+  Serial.println("----- end -----");
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(1000);
+  Serial.printf("Directolor microbenchmarks - %uMHz\n", getCpuFrequencyMhz());
+  runAll();
+}
+
+void loop()
+{
+  if (Serial.available())
+  {
+    while (Serial.available())
+      Serial.read();
+    runAll();
+  }
+}
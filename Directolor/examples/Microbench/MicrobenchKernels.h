@@ -0,0 +1,206 @@
+// The hot paths of sending and receiving, as microbenchmark kernels - each run() does iterations operations and returns a checksum of
+// what it computed, so the compiler can't throw the work away.  Plain C++, so the same kernels are timed on the ESP32 (Microbench.ino,
+// with the cycle counter) and on a PC (extras/Microbench).
+//
+//   commandFrame, groupFrame,    build one frame - what getRadioCommand() does for each kind of command
+//   duplicateFrame, storeFavFrame
+//   crc16                        the CRC over a three channel command frame
+//   padFrame                     the 0x55 padding shift that right aligns a frame in the payload
+//   finishFrame                  both - what processLoop() does to every frame before sending it
+//   checkFrame                   find and CRC check a frame in a payload, as a shade receiver would
+//   decodeFrame                  decode a payload heard in capture mode
+//   remoteMatch                  feed one 32 byte payload to the remote search matcher (checkRadioPayload() in search mode)
+//   enqueue                      queue a command - the commandItems scan in sendMultiChannelCode()
+#ifndef _MicrobenchKernels_h
+#define _MicrobenchKernels_h
+
+#include <stdint.h>
+#include <string.h>
+#include "DirectolorProtocol.h"
+
+struct MicrobenchKernel
+{
+    const char *name;
+    uint32_t (*run)(uint32_t iterations);
+};
+
+static const uint8_t microbenchRadioCode[4] = {0x12, 0xF0, 0x78, 0x09};
+
+inline uint32_t microbenchCommandFrame(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += directolorBuildCommandFrame(payload, microbenchRadioCode, i % 63 + 1, directolor_close, i) + payload[6];
+    return sum;
+}
+
+inline uint32_t microbenchGroupFrame(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += directolorBuildGroupFrame(payload, microbenchRadioCode, 1 << (i % 6), i & 1 ? directolor_join : directolor_remove, i) + payload[6];
+    return sum;
+}
+
+inline uint32_t microbenchDuplicateFrame(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += directolorBuildDuplicateFrame(payload, microbenchRadioCode, i) + payload[6];
+    return sum;
+}
+
+inline uint32_t microbenchStoreFavFrame(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += directolorBuildStoreFavFrame(payload, microbenchRadioCode, i) + payload[6];
+    return sum;
+}
+
+inline uint32_t microbenchCrc16(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    uint8_t length = directolorBuildCommandFrame(payload, microbenchRadioCode, 0x07, directolor_open, 0x1234);
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        payload[6] = i; // the nonce changes with every frame
+        sum += directolorCrc16(payload, length);
+    }
+    return sum;
+}
+
+// Padding the padded frame again does the same work (the same length is shifted, the same bytes are filled), so there's no copy to time.
+inline uint32_t microbenchPadFrame(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    uint8_t length = directolorBuildCommandFrame(payload, microbenchRadioCode, 0x07, directolor_open, 0x1234) + 2;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        directolorPadFrame(payload, length);
+        sum += payload[i % MAX_PAYLOAD_SIZE];
+    }
+    return sum;
+}
+
+inline uint32_t microbenchFinishFrame(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    uint8_t length = directolorBuildCommandFrame(payload, microbenchRadioCode, 0x07, directolor_open, 0x1234);
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        directolorFinishFrame(payload, length);
+        sum += payload[MAX_PAYLOAD_SIZE - 1];
+    }
+    return sum;
+}
+
+inline uint32_t microbenchCheckFrame(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    directolorFinishFrame(payload, directolorBuildCommandFrame(payload, microbenchRadioCode, 0x07, directolor_open, 0x1234));
+    int8_t start = directolorCheckFrame(payload, MAX_PAYLOAD_SIZE);
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        payload[start + 6] = i; // a new nonce - the CRC no longer matches, but that's only found at the end, so it's the same work
+        sum += directolorCheckFrame(payload, MAX_PAYLOAD_SIZE) + 1;
+    }
+    return sum;
+}
+
+inline uint32_t microbenchDecodeFrame(uint32_t iterations)
+{
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    directolorFinishFrame(payload, directolorBuildCommandFrame(payload, microbenchRadioCode, 0x07, directolor_open, 0x1234));
+    int8_t start = directolorCheckFrame(payload, MAX_PAYLOAD_SIZE) + 3; // capture mode gets the payload without the address bytes
+    DirectolorFrame frame;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        payload[start + 6] = i; // the remote code byte the frame reports
+        directolorDecodeFrame(payload + start, MAX_PAYLOAD_SIZE - start, frame);
+        sum += frame.channels + frame.action + frame.radioCode[0];
+    }
+    return sum;
+}
+
+// Search mode hears mostly noise - one payload in eight has a header in it.
+inline uint32_t microbenchRemoteMatch(uint32_t iterations)
+{
+    static const uint8_t header[] = {0x12, 0xF0, DIRECTOLOR_FRAME_MARKER, 0x13, 0x00, 0x05};
+    uint8_t payloads[8][MAX_PAYLOAD_SIZE];
+    uint32_t noise = 0x9E3779B9;
+    for (uint8_t p = 0; p < 8; p++)
+        for (uint8_t i = 0; i < MAX_PAYLOAD_SIZE; i++)
+        {
+            noise = noise * 1664525 + 1013904223;
+            payloads[p][i] = noise >> 24;
+        }
+    memcpy(payloads[5] + 17, header, sizeof(header));
+
+    DirectolorRemoteMatcher matcher;
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        if (matcher.feed(payloads[i & 7], MAX_PAYLOAD_SIZE))
+        {
+            sum += matcher.radioCode(0);
+            matcher.reset();
+        }
+        payloads[5][17] = i; // move the header's first id byte so the match result changes
+    }
+    return sum;
+}
+
+static void microbenchSuperseded(const DirectolorQueueEntry &, uint8_t channels, void *context)
+{
+    *(uint32_t *)context += channels;
+}
+
+// A busy queue: seven remotes, three actions taking channels off each other, and every fourth call a burst going out of one slot.
+inline uint32_t microbenchEnqueue(uint32_t iterations)
+{
+    static const uint8_t actions[] = {directolor_open, directolor_close, directolor_stop};
+    const uint8_t size = 14; // DIRECTOLOR_MAX_QUEUED_COMMANDS with the default seven remotes
+    DirectolorQueueEntry queue[size];
+    memset(queue, 0, sizeof(queue));
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        uint8_t channels = (1 << (i % 6)) | (1 << (i / 6 % 6));
+        if (directolorEnqueue(queue, size, i * 3 % 7 + 1, channels, actions[i % 3], 3, microbenchSuperseded, &sum))
+            sum++;
+        if (!(i & 3))
+        {
+            DirectolorQueueEntry &sent = queue[(i >> 2) % size];
+            if (sent.remote && --sent.resendRemainingCount == 0)
+                sent.remote = 0;
+        }
+    }
+    return sum;
+}
+
+static const MicrobenchKernel microbenchKernels[] = {
+    {"commandFrame", microbenchCommandFrame},
+    {"groupFrame", microbenchGroupFrame},
+    {"duplicateFrame", microbenchDuplicateFrame},
+    {"storeFavFrame", microbenchStoreFavFrame},
+    {"crc16", microbenchCrc16},
+    {"padFrame", microbenchPadFrame},
+    {"finishFrame", microbenchFinishFrame},
+    {"checkFrame", microbenchCheckFrame},
+    {"decodeFrame", microbenchDecodeFrame},
+    {"remoteMatch", microbenchRemoteMatch},
+    {"enqueue", microbenchEnqueue}};
+
+#define MICROBENCH_KERNEL_COUNT (sizeof(microbenchKernels) / sizeof(microbenchKernels[0]))
+
+#endif
@@ -0,0 +1,230 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+/**
+   Replays a capture log (see Directolor::setCaptureLog) through the same decoder the library uses, as fast as the PC will go.
+
+   Build (Linux / macOS):
+     g++ -O2 -I../.. CaptureReplay.cpp -o CaptureReplay
+
+   Usage:
+     CaptureReplay capture.dlc [--repeat N] [--dump]
+
+   --repeat N  run the whole file through the decoder N times (for profiling - statistics are reported for the first pass)
+   --dump      print one line per decoded frame (handy for diffing decoder changes against a known good run)
+
+   The file is memory mapped, so captures larger than RAM are fine.  Anything that isn't a valid record (text from Serial, a record
+   cut short by a power loss) is skipped by scanning for the next sync byte.
+*/
+
+#include "DirectolorProtocol.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct ReplayStats
+{
+  uint64_t records;
+  uint64_t skippedBytes;
+  uint64_t searchRecords;
+  uint64_t frames[directolor_frameDuplicate + 1];
+  uint64_t actions[256];
+  uint64_t channelHits[6];
+  uint64_t discoveries;
+  uint64_t firstDiscoveryPayloads;
+  uint32_t firstDiscoveryMillis;
+};
+
+static const char *frameNames[] = {"unknown", "command", "group", "store favorite", "duplicate"};
+
+static const char *actionName(uint8_t frameType, uint8_t action)
+{
+  if (frameType == directolor_frameGroup)
+    return action == 0x01 ? "join" : action == 0x00 ? "remove" : "?";
+  switch (action)
+  {
+  case 0x55:
+    return "open";
+  case 0x44:
+    return "close";
+  case 0x52:
+    return "tiltOpen";
+  case 0x4C:
+    return "tiltClose";
+  case 0x53:
+    return "stop";
+  case 0x48:
+    return "toFav";
+  }
+  return "?";
+}
+
+static void replay(const uint8_t *data, size_t size, ReplayStats &stats, bool dump)
+{
+  DirectolorRemoteMatcher matcher;
+  uint8_t searchChannel = 0xFF;
+  uint8_t searchStep = 0xFF;
+  uint32_t searchStart = 0;
+  uint64_t searchPayloads = 0;
+  size_t offset = 0;
+
+  while (offset + sizeof(DirectolorCaptureRecord) <= size)
+  {
+    DirectolorCaptureRecord record;
+    memcpy(&record, data + offset, sizeof(record));
+    if (!directolorCaptureRecordValid(record))
+    {
+      const void *next = memchr(data + offset + 1, DIRECTOLOR_CAPTURE_SYNC, size - offset - 1);
+      size_t nextOffset = next ? (const uint8_t *)next - data : size;
+      stats.skippedBytes += nextOffset - offset;
+      offset = nextOffset;
+      continue;
+    }
+    offset += sizeof(record);
+    stats.records++;
+
+    if (record.flags & DIRECTOLOR_CAPTURE_SEARCH_MODE)
+    {
+      stats.searchRecords++;
+      uint8_t channel = record.flags & DIRECTOLOR_CAPTURE_CHANNEL_MASK;
+      uint8_t step = record.pipe >> DIRECTOLOR_CAPTURE_STEP_SHIFT;
+      if (channel != searchChannel || step != searchStep) // the device resets its matcher at every step of its search plan - channel or address width - so do the same
+      {
+        matcher.reset();
+        searchChannel = channel;
+        searchStep = step;
+      }
+      if (!searchPayloads++)
+        searchStart = record.timestamp;
+      if (matcher.feed(record.payload, record.length))
+      {
+        if (!stats.discoveries++)
+        {
+          stats.firstDiscoveryPayloads = searchPayloads;
+          stats.firstDiscoveryMillis = record.timestamp - searchStart;
+        }
+        if (dump)
+          printf("%10u search ch %u: remote %02X %02X C0 (%u channel(s)) after %llu payloads\n", record.timestamp, channel, matcher.radioCode(0), matcher.radioCode(1), matcher.channelCount(), (unsigned long long)searchPayloads);
+        matcher.reset();
+        searchPayloads = 0;
+      }
+      continue;
+    }
+
+    DirectolorFrame frame;
+    directolorDecodeFrame(record.payload, record.length, frame);
+    stats.frames[frame.type]++;
+    if (frame.type == directolor_frameCommand || frame.type == directolor_frameGroup)
+      stats.actions[frame.action]++;
+    for (int i = 0; i < 6; i++)
+      if (frame.channels & (1 << i))
+        stats.channelHits[i]++;
+
+    if (dump)
+    {
+      printf("%10u pipe %u: %-14s", record.timestamp, record.pipe & DIRECTOLOR_CAPTURE_PIPE_MASK, frameNames[frame.type]);
+      if (frame.type == directolor_frameCommand || frame.type == directolor_frameGroup)
+      {
+        printf(" %02X %02X channels", frame.radioCode[0], frame.radioCode[1]);
+        for (int i = 0; i < 6; i++)
+          if (frame.channels & (1 << i))
+            printf(" %d", i + 1);
+        printf(" %s", actionName(frame.type, frame.action));
+      }
+      printf("\n");
+    }
+  }
+  stats.skippedBytes += size - offset;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = 0;
+  int repeat = 1;
+  bool dump = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+      repeat = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--dump"))
+      dump = true;
+    else
+      path = argv[i];
+  }
+  if (!path || repeat < 1)
+  {
+    fprintf(stderr, "usage: %s capture.dlc [--repeat N] [--dump]\n", argv[0]);
+    return 2;
+  }
+
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0)
+  {
+    perror(path);
+    return 1;
+  }
+  if (st.st_size == 0)
+  {
+    fprintf(stderr, "%s: empty capture\n", path);
+    return 1;
+  }
+  const uint8_t *data = (const uint8_t *)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+  madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+  ReplayStats stats;
+  memset(&stats, 0, sizeof(stats));
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  replay(data, st.st_size, stats, dump);
+  for (int i = 1; i < repeat; i++)
+  {
+    ReplayStats scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    replay(data, st.st_size, scratch, false);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t totalRecords = stats.records * repeat;
+  printf("records:          %llu (%llu search mode), %llu bytes skipped\n", (unsigned long long)stats.records, (unsigned long long)stats.searchRecords, (unsigned long long)stats.skippedBytes);
+  for (int i = 0; i <= directolor_frameDuplicate; i++)
+    printf("  %-15s %llu\n", frameNames[i], (unsigned long long)stats.frames[i]);
+  printf("actions:         ");
+  for (int i = 0; i < 256; i++)
+    if (stats.actions[i])
+      printf(" %02X=%llu", i, (unsigned long long)stats.actions[i]);
+  printf("\nchannel hits:    ");
+  for (int i = 0; i < 6; i++)
+    printf(" %d=%llu", i + 1, (unsigned long long)stats.channelHits[i]);
+  printf("\n");
+  if (stats.discoveries)
+    printf("remote discovery: %llu found, first after %llu payloads / %u ms\n", (unsigned long long)stats.discoveries, (unsigned long long)stats.firstDiscoveryPayloads, stats.firstDiscoveryMillis);
+  printf("replay:           %.3f s for %d pass(es), %.0f records/s, %.1f MB/s\n", seconds, repeat, totalRecords / seconds, (double)st.st_size * repeat / seconds / 1e6);
+
+  munmap((void *)data, st.st_size);
+  close(fd);
+  return 0;
+}
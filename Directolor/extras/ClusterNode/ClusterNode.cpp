@@ -0,0 +1,431 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+/**
+   One controller of a multi controller house (DirectolorCluster.h) on a PC - run several to try the coordination on one box.
+
+   Build (Linux / macOS):
+     g++ -O2 -I../.. -I../../examples/Directolor ClusterNode.cpp -o ClusterNode
+
+   Usage:
+     ClusterNode --index N [options]       run node N (0 - 7)
+     ClusterNode --check node*.log         look through the logs of a run for overlapping bursts and double transmissions
+
+   --index N          node N listens on 127.0.0.1 port --port-base + N; cluster datagrams are sent to all eight ports
+   --id X             node id (hex, default 100 + N) - the lowest id leads
+   --affinity LIST    shades this node owns - remote.channelDigits, comma separated (1.123,2.4 = remote 1 channels 1-3, remote 2 channel 4)
+   --auto N           send N random commands, starting at --epoch and --interval ms apart.  Every node given the same --seed gets the
+                      same commands at the same time - a hub sending everything to every controller, the worst case
+   --lifetime MS      exit after this long - to watch failover
+   --burst MS         how long a burst keeps the air (default 190, roughly MESSAGE_SEND_RETRIES on real hardware)
+   commands can also be typed on stdin, one per line in the same remote.channels.action form
+
+   Radio: the queue follows Directolor's (merge same action, take channels off a different action, MESSAGE_SEND_ATTEMPTS bursts
+   INTERMESSAGE_SEND_DELAY apart, walked round robin) and asks the cluster before every burst, as processLoop() does through
+   setTransmitGate().  A burst just blocks for --burst ms and logs its start and end times, so --check can line the nodes up.
+
+   Three nodes, one failing part way through:
+     epoch=$(( $(date +%s) + 5 ))
+     ./ClusterNode --index 0 --auto 30 --epoch $epoch --lifetime 15000 > node0.log &
+     ./ClusterNode --index 1 --auto 30 --epoch $epoch --affinity 1.12 > node1.log &
+     ./ClusterNode --index 2 --auto 30 --epoch $epoch --affinity 1.3456,2.123456 > node2.log &
+     wait; ./ClusterNode --check node*.log
+*/
+
+#include "DirectolorCluster.h"
+#include "ControlRequest.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define QUEUE_SIZE 14 // DIRECTOLOR_MAX_QUEUED_COMMANDS for seven remotes
+
+static uint32_t monotonicMillis()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000ull + now.tv_nsec / 1000000;
+}
+
+static uint64_t wallMillis() // the logs of different processes are lined up on this
+{
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return now.tv_sec * 1000ull + now.tv_nsec / 1000000;
+}
+
+struct QueuedCommand
+{
+  uint8_t remote; // 0 - free
+  uint8_t channels;
+  uint8_t action;
+  uint8_t remaining;
+};
+
+struct Datagram
+{
+  std::vector<uint8_t> data;
+  uint32_t arrived;
+};
+
+struct Node
+{
+  int fd;
+  std::vector<Datagram> received; // waiting for the cluster - stamped when they arrived, as ControlCluster does
+  uint16_t portBase;
+  uint32_t id;
+  uint16_t burstMs;
+  QueuedCommand queue[QUEUE_SIZE];
+  int next;
+  uint32_t lastSend;
+  uint32_t held; // bursts the cluster made wait
+  uint32_t bursts;
+};
+
+static void sendDatagram(const uint8_t *data, uint8_t length, void *context)
+{
+  Node *node = (Node *)context;
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int i = 0; i < DIRECTOLOR_CLUSTER_MAX_NODES; i++)
+  {
+    address.sin_port = htons(node->portBase + i);
+    sendto(node->fd, data, length, 0, (struct sockaddr *)&address, sizeof(address));
+  }
+}
+
+// Takes whatever datagrams arrive in the next timeoutMs - on the device that's the AsyncUDP task, which keeps going during a burst.
+static void receiveFor(Node &node, int timeoutMs)
+{
+  uint32_t until = monotonicMillis() + timeoutMs;
+  do
+  {
+    struct pollfd waitFor = {node.fd, POLLIN, 0};
+    if (poll(&waitFor, 1, (int32_t)(until - monotonicMillis()) > 0 ? until - monotonicMillis() : 0) <= 0)
+      continue;
+    Datagram datagram;
+    datagram.data.resize(DIRECTOLOR_CLUSTER_MAX_DATAGRAM + 1);
+    ssize_t length = recv(node.fd, datagram.data.data(), datagram.data.size(), 0);
+    datagram.arrived = monotonicMillis();
+    if (length > 0)
+    {
+      datagram.data.resize(length);
+      node.received.push_back(datagram);
+    }
+  } while ((int32_t)(until - monotonicMillis()) > 0);
+}
+
+// Directolor::sendMultiChannelCode's queue rules.
+static void enqueue(uint8_t remote, uint8_t channels, uint8_t action, void *context)
+{
+  Node *node = (Node *)context;
+  printf("%llu enqueue remote %u channels %u %s\n", (unsigned long long)wallMillis(), remote, channels, directolorActionName(action));
+  QueuedCommand *queued = 0;
+  for (int i = 0; i < QUEUE_SIZE; i++)
+  {
+    QueuedCommand &item = node->queue[i];
+    if (item.remote != remote)
+      continue;
+    if (item.action == action)
+      queued = &item;
+    else if ((item.channels & channels) && action != directolor_join && action != directolor_remove)
+    {
+      item.channels &= ~channels;
+      if (!item.channels)
+        item.remote = 0;
+    }
+  }
+  for (int i = 0; i < QUEUE_SIZE && !queued; i++)
+    if (!node->queue[i].remote)
+    {
+      queued = &node->queue[i];
+      queued->remote = remote;
+      queued->channels = 0;
+      queued->action = action;
+    }
+  if (!queued)
+    return;
+  queued->channels |= channels;
+  queued->remaining = MESSAGE_SEND_ATTEMPTS;
+}
+
+// Directolor::processLoop - one queue slot per call.
+static void processLoop(Node &node, DirectolorCluster &cluster)
+{
+  if (++node.next == QUEUE_SIZE)
+    node.next = 0;
+  QueuedCommand &item = node.queue[node.next];
+  if (!item.remote || monotonicMillis() - node.lastSend <= INTERMESSAGE_SEND_DELAY)
+    return;
+  uint16_t frames = item.action == directolor_setFav ? 2 : 1;
+  if (!cluster.mayTransmit(DIRECTOLOR_POWER_UP_DELAY_MS + node.burstMs * frames, monotonicMillis()))
+  {
+    node.held++;
+    return;
+  }
+
+  uint64_t start = wallMillis();
+  receiveFor(node, DIRECTOLOR_POWER_UP_DELAY_MS + node.burstMs * frames); // the burst
+  printf("%llu tx %llu %llu node %x remote %u channels %u %s\n", (unsigned long long)wallMillis(), (unsigned long long)start, (unsigned long long)wallMillis(), node.id, item.remote, item.channels, directolorActionName(item.action));
+  node.bursts++;
+  node.lastSend = monotonicMillis();
+  if (--item.remaining == 0)
+    item.remote = 0;
+}
+
+static void command(DirectolorCluster &cluster, const char *text, size_t length)
+{
+  int remote, action;
+  uint8_t channels;
+  if (controlParseBatchItem(text, length, remote, channels, action) && remote <= DIRECTOLOR_CLUSTER_REMOTES)
+    cluster.route(remote, channels, action, monotonicMillis());
+  else
+    fprintf(stderr, "bad command %.*s - remote.channelDigits.action\n", (int)length, text);
+}
+
+struct Burst
+{
+  uint64_t start;
+  uint64_t end;
+  uint32_t node;
+  unsigned remote;
+  unsigned channels;
+  char action[16];
+};
+
+static int check(int count, char **paths)
+{
+  std::vector<Burst> bursts;
+  for (int i = 0; i < count; i++)
+  {
+    FILE *log = fopen(paths[i], "r");
+    if (!log)
+    {
+      perror(paths[i]);
+      return 1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), log))
+    {
+      Burst burst;
+      unsigned long long stamp, start, end;
+      if (sscanf(line, "%llu tx %llu %llu node %x remote %u channels %u %15s", &stamp, &start, &end, &burst.node, &burst.remote, &burst.channels, burst.action) == 7)
+      {
+        burst.start = start;
+        burst.end = end;
+        bursts.push_back(burst);
+      }
+    }
+    fclose(log);
+  }
+  std::sort(bursts.begin(), bursts.end(), [](const Burst &a, const Burst &b) { return a.start < b.start; });
+
+  int overlaps = 0;
+  int doubles = 0; // the same shade and action sent by two nodes within one command's lifetime
+  for (size_t i = 0; i < bursts.size(); i++)
+  {
+    for (size_t j = i + 1; j < bursts.size() && bursts[j].start < bursts[i].start + 2000; j++)
+    {
+      if (bursts[j].node == bursts[i].node)
+        continue;
+      if (bursts[j].start < bursts[i].end)
+      {
+        overlaps++;
+        printf("overlap: node %x %llu-%llu and node %x %llu-%llu\n", bursts[i].node, (unsigned long long)bursts[i].start, (unsigned long long)bursts[i].end, bursts[j].node, (unsigned long long)bursts[j].start, (unsigned long long)bursts[j].end);
+      }
+      if (bursts[j].remote == bursts[i].remote && (bursts[j].channels & bursts[i].channels) && !strcmp(bursts[j].action, bursts[i].action))
+        doubles++;
+    }
+  }
+  printf("%zu bursts, %d overlapping, %d sent by more than one node\n", bursts.size(), overlaps, doubles);
+  return overlaps || doubles ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  int index = -1;
+  uint32_t id = 0;
+  uint16_t portBase = 24540;
+  const char *affinity = 0;
+  int autoCount = 0;
+  unsigned seed = 1;
+  long long epoch = 0;
+  int interval = 700;
+  int lifetime = 0;
+  int burst = 190;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--check"))
+      return check(argc - i - 1, argv + i + 1);
+    else if (!strcmp(argv[i], "--index") && i + 1 < argc)
+      index = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--id") && i + 1 < argc)
+      id = strtoul(argv[++i], 0, 16);
+    else if (!strcmp(argv[i], "--port-base") && i + 1 < argc)
+      portBase = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--affinity") && i + 1 < argc)
+      affinity = argv[++i];
+    else if (!strcmp(argv[i], "--auto") && i + 1 < argc)
+      autoCount = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+      seed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--epoch") && i + 1 < argc)
+      epoch = atoll(argv[++i]);
+    else if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+      interval = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--lifetime") && i + 1 < argc)
+      lifetime = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--burst") && i + 1 < argc)
+      burst = atoi(argv[++i]);
+    else
+      index = -1, i = argc;
+  }
+  if (index < 0 || index >= DIRECTOLOR_CLUSTER_MAX_NODES)
+  {
+    fprintf(stderr, "usage: %s --index N [--id X] [--port-base P] [--affinity 1.123,2.4] [--auto N [--seed S] [--epoch SECONDS] [--interval MS]] [--lifetime MS] [--burst MS]\n"
+                    "       %s --check node0.log node1.log ...\n", argv[0], argv[0]);
+    return 2;
+  }
+  setvbuf(stdout, 0, _IOLBF, 0);
+
+  Node node = Node();
+  node.portBase = portBase;
+  node.id = id ? id : 0x100 + index;
+  node.burstMs = burst;
+  node.fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(portBase + index);
+  if (node.fd < 0 || bind(node.fd, (struct sockaddr *)&address, sizeof(address)))
+  {
+    perror("bind");
+    return 1;
+  }
+
+  DirectolorCluster cluster(node.id, sendDatagram, enqueue, &node);
+  for (const char *item = affinity; item && *item;)
+  {
+    const char *end = strchr(item, ',');
+    size_t length = end ? end - item : strlen(item);
+    const char *dot = (const char *)memchr(item, '.', length);
+    uint8_t channels = 0;
+    for (const char *c = dot ? dot + 1 : item + length; c < item + length; c++)
+      if (*c >= '1' && *c <= '6')
+        channels |= 1 << (*c - '1');
+    if (!dot || !channels)
+    {
+      fprintf(stderr, "bad affinity %.*s - remote.channelDigits\n", (int)length, item);
+      return 2;
+    }
+    cluster.setAffinity(atoi(item), channels);
+    item = end ? end + 1 : item + length;
+  }
+
+  std::mt19937 random(seed);
+  static const char *const actions[] = {"open", "close", "stop", "tiltOpen", "tiltClose", "toFav"};
+  std::vector<std::string> script;
+  for (int i = 0; i < autoCount; i++)
+  {
+    char text[32];
+    snprintf(text, sizeof(text), "%u.", (unsigned)(random() % 3 + 1));
+    for (int channel = 1; channel <= 6; channel++)
+      if (random() % 3 == 0 || channel == 6)
+      {
+        snprintf(text + strlen(text), sizeof(text) - strlen(text), "%d", channel);
+        if (random() % 2)
+          break;
+      }
+    snprintf(text + strlen(text), sizeof(text) - strlen(text), ".%s", actions[random() % 6]);
+    script.push_back(text);
+  }
+  uint64_t scriptStart = epoch ? epoch * 1000ull : wallMillis() + 5000;
+  size_t scriptNext = 0;
+
+  uint32_t startedAt = monotonicMillis();
+  cluster.begin(startedAt);
+  printf("%llu node %x listening on %u\n", (unsigned long long)wallMillis(), node.id, portBase + index);
+
+  uint32_t reportedLeader = 0;
+  uint8_t reportedNodes = 0;
+  char input[256];
+  size_t inputLength = 0;
+  bool stdinOpen = true;
+  while (!lifetime || monotonicMillis() - startedAt < (uint32_t)lifetime)
+  {
+    receiveFor(node, 2);
+    for (size_t i = 0; i < node.received.size(); i++)
+      cluster.receive(node.received[i].data.data(), node.received[i].data.size(), node.received[i].arrived);
+    node.received.clear();
+
+    struct pollfd waitFor = {stdinOpen ? 0 : -1, POLLIN, 0};
+    poll(&waitFor, 1, 0);
+    if (waitFor.revents & (POLLIN | POLLHUP))
+    {
+      ssize_t length = read(0, input + inputLength, sizeof(input) - inputLength);
+      if (length <= 0)
+        stdinOpen = false;
+      else
+        inputLength += length;
+      char *newline;
+      while ((newline = (char *)memchr(input, '\n', inputLength)) != 0)
+      {
+        if (newline > input)
+          command(cluster, input, newline - input);
+        inputLength -= newline + 1 - input;
+        memmove(input, newline + 1, inputLength);
+      }
+      if (inputLength == sizeof(input))
+        inputLength = 0;
+    }
+
+    while (scriptNext < script.size() && wallMillis() >= scriptStart + scriptNext * interval)
+    {
+      command(cluster, script[scriptNext].c_str(), script[scriptNext].size());
+      scriptNext++;
+    }
+
+    cluster.poll(monotonicMillis());
+    if (cluster.leader() != reportedLeader || cluster.nodeCount() != reportedNodes)
+    {
+      reportedLeader = cluster.leader();
+      reportedNodes = cluster.nodeCount();
+      printf("%llu %u node(s), leader %x\n", (unsigned long long)wallMillis(), reportedNodes, reportedLeader);
+    }
+    processLoop(node, cluster);
+
+    bool idle = true;
+    for (int i = 0; i < QUEUE_SIZE; i++)
+      idle &= !node.queue[i].remote;
+    if (!lifetime && autoCount && scriptNext == script.size() && idle && wallMillis() > scriptStart + script.size() * interval + 3000)
+      break; // scripted run finished
+  }
+  printf("%llu done - %u bursts, %u held for another node's slot\n", (unsigned long long)wallMillis(), node.bursts, node.held);
+  return 0;
+}
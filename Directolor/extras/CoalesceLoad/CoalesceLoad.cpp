@@ -0,0 +1,220 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+/**
+   Load test for the control plane's coalescing window (ControlCoalesce.h) - a hub closing every shade in the house, with and without
+   the window, counting the radio bursts it costs and how long until the last of them is done.
+
+   Build (Linux / macOS):
+     g++ -O2 -I../.. -I../../examples/Directolor CoalesceLoad.cpp -o CoalesceLoad
+
+   Usage:
+     CoalesceLoad [options]
+
+   --shades N     shades closed, 6 to a remote (default 12)
+   --spacing MS   time between the hub's requests, one per shade (default 0.5)
+   --window MS    coalescing window (default CONTROL_PLANE_COALESCE_MS)
+   --burst MS     how long a burst keeps loop() busy - the 20ms power up plus MESSAGE_SEND_RETRIES packets (default 210)
+   --loop MS      how long loop() takes when there's nothing to send (default 0.1)
+
+   Each run follows the web example's loop(): requests that arrived while loop() was busy are handed to ControlPlane together, go
+   through the ControlCoalescer and then into the library's directolorEnqueue(), and processLoop() walks the queue round robin with
+   MESSAGE_SEND_ATTEMPTS bursts INTERMESSAGE_SEND_DELAY apart.  directolorEnqueue() merges into a queued entry for as long as it is
+   queued and starts its attempts over - so channels merged in after the entry's first burst missed that burst, and the entry costs
+   a burst more.  Time is simulated, so the results are exact and repeatable.
+
+   Three runs: one request per shade with no window (CONTROL_PLANE_COALESCE_MS 0), the same with --window, and the whole house in one
+   /api/batch request (what the Hubitat driver sends).  Exits 1 unless the window takes fewer bursts and finishes sooner than no
+   window - with the defaults the first burst goes out before the other requests are in, and every remote it touches needs a burst
+   more.
+*/
+
+#include "DirectolorProtocol.h"
+#include "ControlCoalesce.h"
+
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUEUE_SIZE 14 // DIRECTOLOR_MAX_QUEUED_COMMANDS (Directolor.h)
+#define REMOTE_CHANNELS 6
+
+struct Options
+{
+  int shades = 12;
+  double spacingMs = 0.5;
+  double windowMs = CONTROL_PLANE_COALESCE_MS;
+  double burstMs = 210;
+  double loopMs = 0.1;
+};
+
+struct Arrival
+{
+  unsigned long at; // us
+  ControlCommand command;
+};
+
+struct Result
+{
+  int bursts;
+  double lastShadeMs; // until the last shade's first burst has gone out
+  double completeMs;  // until the queue is empty
+};
+
+class Load
+{
+public:
+  Load(const Options &o, const std::vector<Arrival> &arrivals, double windowMs)
+      : o(o), arrivals(arrivals), coalescer(dispatch, this, (unsigned long)(windowMs * 1000)) {}
+
+  Result run()
+  {
+    Result result = {0, 0, 0};
+    memset(queue, 0, sizeof(queue));
+    std::vector<bool> reached(o.shades, false);
+    int unreached = o.shades;
+    size_t next = 0;
+    unsigned long now = 0;
+    unsigned long lastSend = 0;
+    bool sent = false;
+    uint8_t lastCommand = 0;
+
+    for (;;)
+    {
+      // ControlPlane::processLoop() - everything that arrived while loop() was busy, then the window
+      while (next < arrivals.size() && arrivals[next].at <= now)
+        coalescer.add(arrivals[next++].command, now);
+      coalescer.poll(now);
+
+      // Directolor::processLoop()
+      if (++lastCommand == QUEUE_SIZE)
+        lastCommand = 0;
+      DirectolorQueueEntry &entry = queue[lastCommand];
+      if ((!sent || now - lastSend > (INTERMESSAGE_SEND_DELAY) * 1000UL) && entry.remote)
+      {
+        now += (unsigned long)(o.burstMs * 1000);
+        lastSend = now;
+        sent = true;
+        result.bursts++;
+        for (int s = 0; s < o.shades; s++)
+          if (!reached[s] && entry.remote == s / REMOTE_CHANNELS + 1 && entry.channels & (1 << s % REMOTE_CHANNELS))
+          {
+            reached[s] = true;
+            unreached--;
+            result.lastShadeMs = now / 1000.0;
+          }
+        if (--entry.resendRemainingCount == 0)
+          entry.remote = 0;
+      }
+      else
+        now += (unsigned long)(o.loopMs * 1000);
+
+      if (next == arrivals.size() && !coalescer.held() && !queued())
+        break;
+      if (now > 600000000UL) // ten minutes - something is stuck
+      {
+        fprintf(stderr, "the queue never emptied\n");
+        exit(1);
+      }
+    }
+    result.completeMs = now / 1000.0;
+    if (unreached)
+      result.lastShadeMs = -1;
+    return result;
+  }
+
+private:
+  const Options &o;
+  const std::vector<Arrival> &arrivals;
+  ControlCoalescer coalescer;
+  DirectolorQueueEntry queue[QUEUE_SIZE];
+
+  static void dispatch(const ControlCommand &command, void *context) // what ControlPlane does with a command once the window is over
+  {
+    Load *load = (Load *)context;
+    if (!directolorEnqueue(load->queue, QUEUE_SIZE, command.remote, command.channels, command.action, MESSAGE_SEND_ATTEMPTS))
+      fprintf(stderr, "queue full - remote %u channels %u dropped\n", command.remote, command.channels);
+  }
+
+  bool queued() const
+  {
+    for (int i = 0; i < QUEUE_SIZE; i++)
+      if (queue[i].remote)
+        return true;
+    return false;
+  }
+};
+
+static std::vector<Arrival> hubRequests(const Options &o, double spacingMs) // close every shade, one command per shade
+{
+  std::vector<Arrival> arrivals;
+  for (int s = 0; s < o.shades; s++)
+  {
+    Arrival arrival = {(unsigned long)(s * spacingMs * 1000), {(uint8_t)(s / REMOTE_CHANNELS + 1), (uint8_t)(1 << s % REMOTE_CHANNELS), directolor_close}};
+    arrivals.push_back(arrival);
+  }
+  return arrivals;
+}
+
+static void print(const char *name, const Result &r)
+{
+  printf("%-28s %7d %14.1f %12.1f\n", name, r.bursts, r.lastShadeMs, r.completeMs);
+}
+
+int main(int argc, char **argv)
+{
+  Options o;
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--shades") && i + 1 < argc)
+      o.shades = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--spacing") && i + 1 < argc)
+      o.spacingMs = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--window") && i + 1 < argc)
+      o.windowMs = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--burst") && i + 1 < argc)
+      o.burstMs = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--loop") && i + 1 < argc)
+      o.loopMs = atof(argv[++i]);
+    else
+    {
+      fprintf(stderr, "usage: %s [--shades N] [--spacing MS] [--window MS] [--burst MS] [--loop MS]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (o.shades < 1 || o.shades > QUEUE_SIZE / 2 * REMOTE_CHANNELS || o.spacingMs < 0 || o.windowMs < 0 || o.burstMs <= 0 || o.loopMs <= 0)
+  {
+    fprintf(stderr, "--shades has to be 1 - %d, --burst and --loop more than 0, --spacing and --window 0 or more\n", QUEUE_SIZE / 2 * REMOTE_CHANNELS);
+    return 1;
+  }
+
+  std::vector<Arrival> perShade = hubRequests(o, o.spacingMs);
+  std::vector<Arrival> batch = hubRequests(o, 0);
+
+  Result unmerged = Load(o, perShade, 0).run();
+  Result merged = Load(o, perShade, o.windowMs).run();
+  Result batched = Load(o, batch, o.windowMs).run();
+
+  printf("%d shades, a request every %.2fms, %.1fms window, %.0fms bursts\n\n", o.shades, o.spacingMs, o.windowMs, o.burstMs);
+  printf("%-28s %7s %14s %12s\n", "", "bursts", "last shade ms", "complete ms");
+  print("per shade, no window", unmerged);
+  print("per shade, window", merged);
+  print("one /api/batch request", batched);
+
+  bool pass = merged.bursts < unmerged.bursts && merged.completeMs < unmerged.completeMs;
+  printf("\n%s - the window %s\n", pass ? "PASS" : "FAIL",
+         pass ? "saves bursts and finishes sooner" : "doesn't save bursts and time here (is --spacing * --shades longer than --window?)");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,480 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+/**
+   Serves the web example's control plane on a PC and load tests it with a local HTTP client.  The connections are the example's own
+   ControlConnection - the same request handling, replies and page streaming as on the ESP32 - so what's measured is that code.
+
+   Build (Linux / macOS):
+     g++ -O2 -pthread -I../.. -I../../examples/Directolor ControlBench.cpp -o ControlBench
+
+   Usage:
+     ControlBench [--clients N] [--requests N] [--space BYTES]    serve on loopback and time each kind of request
+     ControlBench --serve PORT [--space BYTES]                     only serve, for another client (curl, ab, wrk...)
+
+   The server is one thread driving every connection from poll(), the way the AsyncTCP task does, with the same
+   CONTROL_PLANE_MAX_CLIENTS connection slots (more get a 503).  add() copies into a --space byte send buffer per connection (default
+   5744, the ESP32's TCP send buffer) that goes to the socket as it has room, and what the socket takes counts as acked - so the page
+   is streamed in pieces, as it is on the ESP32.  Commands aren't sent anywhere: each one becomes an "enqueued" event for the streams.
+
+   The client runs --clients threads (default 4), one connection per request as a hub does, and an /events stream that counts the
+   events it gets.  For each kind of request it reports requests per second, the client's round trip (median, p99) and the server's
+   own time per request - the time spent in ControlConnection, which is what the ESP32 spends on the AsyncTCP task - and checks that
+   none of it allocates.
+*/
+
+#include "ControlConnection.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define CONTROL_PLANE_MAX_CLIENTS 6 // as ControlPlane.h
+#define BENCH_REMOTES 7
+#define BENCH_CHANNELS 6
+#define BENCH_MAX_SPACE 65536
+
+typedef std::chrono::steady_clock Clock;
+
+// operator new is counted while the server is inside ControlConnection - there should be none
+static thread_local bool handling = false;
+static std::atomic<unsigned> handlerAllocations(0);
+
+void *operator new(size_t size)
+{
+  if (handling)
+    handlerAllocations++;
+  void *memory = malloc(size ? size : 1);
+  if (!memory)
+    throw std::bad_alloc();
+  return memory;
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+struct HostClient
+{
+  int fd;
+  char out[BENCH_MAX_SPACE];
+  size_t outLength;
+  size_t acked; // written to the socket since the last acked() call
+  bool closing;
+};
+
+static size_t space = 5744;
+
+static size_t hostSpace(void *client)
+{
+  return space - ((HostClient *)client)->outLength;
+}
+
+static size_t hostAdd(void *client, const char *data, size_t length)
+{
+  HostClient *host = (HostClient *)client;
+  length = std::min(length, space - host->outLength);
+  memcpy(host->out + host->outLength, data, length);
+  host->outLength += length;
+  return length;
+}
+
+static void hostSend(void *client)
+{
+  HostClient *host = (HostClient *)client;
+  ssize_t written = host->outLength ? send(host->fd, host->out, host->outLength, MSG_NOSIGNAL) : 0;
+  if (written <= 0)
+    return;
+  memmove(host->out, host->out + written, host->outLength - written);
+  host->outLength -= written;
+  host->acked += written; // reported to the connection from the poll loop, as AsyncTCP's ack callback comes later
+}
+
+static void hostClose(void *client)
+{
+  ((HostClient *)client)->closing = true; // the socket is closed once the send buffer has gone, as tcp_close() does
+}
+
+static const ControlTransport transport = {hostSpace, hostAdd, hostSend, hostClose};
+
+struct Server
+{
+  ControlConnection slots[CONTROL_PLANE_MAX_CLIENTS];
+  HostClient clients[CONTROL_PLANE_MAX_CLIENTS];
+  ControlService service;
+  ControlCommand events[64]; // commands enqueued since the last broadcast
+  unsigned eventCount;
+  unsigned enqueued;
+  unsigned broadcasts, dropped, busy;
+  std::atomic<unsigned> requests;        // connections closed after a reply
+  std::atomic<uint64_t> handlerNanos;    // time spent in ControlConnection
+  std::atomic<bool> stop;
+};
+
+static bool serverEnqueue(const ControlCommand &command, void *context)
+{
+  Server *server = (Server *)context;
+  if (server->eventCount == sizeof(server->events) / sizeof(server->events[0]))
+    return false;
+  server->events[server->eventCount++] = command;
+  server->enqueued++;
+  return true;
+}
+
+static unsigned serverWaiting(void *context)
+{
+  return ((Server *)context)->eventCount;
+}
+
+static int serverStatus(char *body, size_t size, void *context)
+{
+  Server *server = (Server *)context;
+  int streams = 0;
+  for (int i = 0; i < CONTROL_PLANE_MAX_CLIENTS; i++)
+    streams += server->slots[i].client() && server->slots[i].streaming();
+  return snprintf(body, size, "{\"remotes\":%d,\"channels\":%d,\"pending\":%u,\"streams\":%d,\"dropped\":%u,\"radio\":\"up\"}", BENCH_REMOTES, BENCH_CHANNELS, server->eventCount, streams, server->dropped);
+}
+
+template <typename Work>
+static void handle(Server &server, Work work)
+{
+  handling = true;
+  Clock::time_point start = Clock::now();
+  work();
+  server.handlerNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+  handling = false;
+}
+
+// What ControlPlane::onEvent / broadcast do on loop() - here on the same thread, after each round of socket work.  Not counted in
+// the time per request (it isn't the AsyncTCP task's), but it mustn't allocate either.
+static void broadcast(Server &server)
+{
+  handling = true;
+  for (unsigned e = 0; e < server.eventCount; e++)
+  {
+    char data[192];
+    const ControlCommand &command = server.events[e];
+    int length = snprintf(data, sizeof(data), "event: enqueued\ndata: {\"remote\":%u,\"channels\":%u,\"action\":\"%s\",\"remaining\":3,\"ms\":0}\n\n", command.remote, command.channels, directolorActionName(command.action));
+    server.broadcasts++;
+    for (int i = 0; i < CONTROL_PLANE_MAX_CLIENTS; i++)
+      if (server.slots[i].client() && server.slots[i].streaming() && !server.slots[i].event(data, length))
+        server.dropped++;
+  }
+  server.eventCount = 0;
+  handling = false;
+}
+
+static void release(Server &server, int i)
+{
+  close(server.clients[i].fd);
+  server.slots[i].begin(0, &transport, &server.service);
+}
+
+// Passes on what the sockets have taken (AsyncTCP's ack callbacks) and closes the connections that are done.  True if any connection
+// got an ack - it may have written more, so there's more to pass on straight away.
+static bool settle(Server &server)
+{
+  bool acked = false;
+  for (int i = 0; i < CONTROL_PLANE_MAX_CLIENTS; i++)
+  {
+    HostClient &client = server.clients[i];
+    if (!server.slots[i].client())
+      continue;
+    if (client.acked)
+    {
+      size_t length = client.acked;
+      client.acked = 0;
+      acked = true;
+      handle(server, [&]() { server.slots[i].acked(length); });
+    }
+    if (client.closing && !client.outLength)
+    {
+      server.requests++;
+      release(server, i);
+    }
+  }
+  return acked;
+}
+
+static void serve(Server &server, int listener)
+{
+  while (!server.stop)
+  {
+    bool busy = settle(server);
+    struct pollfd fds[CONTROL_PLANE_MAX_CLIENTS + 1];
+    int slotOf[CONTROL_PLANE_MAX_CLIENTS + 1];
+    int count = 0;
+    fds[count].fd = listener;
+    fds[count].events = POLLIN;
+    slotOf[count++] = -1;
+    for (int i = 0; i < CONTROL_PLANE_MAX_CLIENTS; i++)
+      if (server.slots[i].client())
+      {
+        fds[count].fd = server.clients[i].fd;
+        fds[count].events = POLLIN | (server.clients[i].outLength ? POLLOUT : 0);
+        slotOf[count++] = i;
+      }
+    if (poll(fds, count, busy ? 0 : 20) <= 0)
+      continue;
+
+    for (int f = 1; f < count; f++)
+    {
+      int i = slotOf[f];
+      HostClient &client = server.clients[i];
+      if (fds[f].revents & POLLOUT)
+        hostSend(&client);
+      if (fds[f].revents & (POLLIN | POLLHUP | POLLERR))
+      {
+        char data[1024];
+        ssize_t received = recv(client.fd, data, sizeof(data), 0);
+        if (received <= 0 && !(received < 0 && errno == EAGAIN))
+        {
+          release(server, i); // the client went away (an event stream ending)
+          continue;
+        }
+        if (received > 0)
+          handle(server, [&]() { server.slots[i].receive(data, received); });
+      }
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+      int fd = accept(listener, 0, 0);
+      if (fd >= 0)
+      {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        int i = 0;
+        while (i < CONTROL_PLANE_MAX_CLIENTS && server.slots[i].client())
+          i++;
+        if (i == CONTROL_PLANE_MAX_CLIENTS)
+        {
+          send(fd, controlBusyResponse, sizeof(controlBusyResponse) - 1, MSG_NOSIGNAL);
+          close(fd);
+          server.busy++;
+        }
+        else
+        {
+          fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+          HostClient &client = server.clients[i];
+          client.fd = fd;
+          client.outLength = 0;
+          client.acked = 0;
+          client.closing = false;
+          server.slots[i].begin(&client, &transport, &server.service);
+        }
+      }
+    }
+    broadcast(server);
+  }
+}
+
+static int listenOn(uint16_t port, uint32_t address)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in bound;
+  memset(&bound, 0, sizeof(bound));
+  bound.sin_family = AF_INET;
+  bound.sin_addr.s_addr = htonl(address);
+  bound.sin_port = htons(port);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&bound, sizeof(bound)) || listen(fd, 64))
+  {
+    perror("listen");
+    exit(1);
+  }
+  return fd;
+}
+
+static int connectTo(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)))
+  {
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return fd;
+}
+
+// One request on a fresh connection, read to the end.  Returns the status code (0 if the connection failed).
+static int httpGet(uint16_t port, const char *path)
+{
+  int fd = connectTo(port);
+  if (fd < 0)
+    return 0;
+  char request[512];
+  int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n", path);
+  send(fd, request, length, MSG_NOSIGNAL);
+
+  char reply[8192];
+  size_t received = 0;
+  for (ssize_t chunk; (chunk = recv(fd, reply + std::min(received, (size_t)16), sizeof(reply) - 16, 0)) > 0;)
+    received += chunk; // only the status line is kept - the rest is read and dropped
+  close(fd);
+  return received > 12 && !memcmp(reply, "HTTP/1.1 ", 9) ? atoi(reply + 9) : 0;
+}
+
+struct Endpoint
+{
+  const char *name;
+  const char *path;
+};
+
+static const Endpoint endpoints[] = {
+    {"page", "/"},
+    {"page+command", "/?remote=1&channel=2&action=open"},
+    {"api", "/api?remote=1&channels=5&action=close"},
+    {"batch (6)", "/api/batch?cmds=1.1.open,1.2.open,1.3.open,2.1.open,2.2.open,2.3.open"},
+    {"status", "/api/status"},
+    {"not found", "/favicon.ico"}};
+
+int main(int argc, char **argv)
+{
+  int clients = 4;
+  int requests = 2000;
+  int servePort = -1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--clients") && i + 1 < argc)
+      clients = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--requests") && i + 1 < argc)
+      requests = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--space") && i + 1 < argc)
+      space = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--serve") && i + 1 < argc)
+      servePort = atoi(argv[++i]);
+    else
+    {
+      fprintf(stderr, "usage: %s [--clients N] [--requests N] [--space BYTES]\n       %s --serve PORT [--space BYTES]\n", argv[0], argv[0]);
+      return 2;
+    }
+  }
+  if (clients < 1 || clients >= CONTROL_PLANE_MAX_CLIENTS || requests < 1 || space < 64 || space > BENCH_MAX_SPACE)
+  {
+    fprintf(stderr, "--clients must be 1 - %d (one slot is the event stream), --requests at least 1, --space 64 - %d\n", CONTROL_PLANE_MAX_CLIENTS - 1, BENCH_MAX_SPACE);
+    return 2;
+  }
+
+  static Server server;
+  server.service.remotes = BENCH_REMOTES;
+  server.service.enqueue = serverEnqueue;
+  server.service.waiting = serverWaiting;
+  server.service.status = serverStatus;
+  server.service.context = &server;
+  for (int i = 0; i < CONTROL_PLANE_MAX_CLIENTS; i++)
+    server.slots[i].begin(0, &transport, &server.service);
+
+  if (servePort >= 0)
+  {
+    printf("serving on port %d\n", servePort);
+    serve(server, listenOn(servePort, INADDR_ANY));
+    return 0;
+  }
+
+  int listener = listenOn(0, INADDR_LOOPBACK);
+  struct sockaddr_in bound;
+  socklen_t boundLength = sizeof(bound);
+  getsockname(listener, (struct sockaddr *)&bound, &boundLength);
+  uint16_t port = ntohs(bound.sin_port);
+  std::thread serverThread(serve, std::ref(server), listener);
+
+  // the event stream - counts the events it gets until the server side goes quiet
+  std::atomic<unsigned> eventsReceived(0);
+  int streamFd = connectTo(port);
+  const char streamRequest[] = "GET /events HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+  send(streamFd, streamRequest, sizeof(streamRequest) - 1, MSG_NOSIGNAL);
+  std::thread streamThread([&]() {
+    char data[4096];
+    char previous = 0;
+    for (ssize_t received; (received = recv(streamFd, data, sizeof(data), 0)) > 0;)
+      for (ssize_t i = 0; i < received; previous = data[i++])
+        if (previous == '\n' && data[i] == '\n')
+          eventsReceived++;
+  });
+
+  printf("control plane on loopback - %d clients, %d requests each kind, %zu byte send buffer\n\n", clients, requests, space);
+  printf("%-14s %9s %10s %10s %14s %7s\n", "request", "req/s", "median us", "p99 us", "server us/req", "failed");
+  bool failed = false;
+  for (const Endpoint &endpoint : endpoints)
+  {
+    int expected = strcmp(endpoint.name, "not found") ? 200 : 404;
+    std::vector<std::vector<double>> micros(clients);
+    std::atomic<int> failures(0);
+    unsigned requestsBefore = server.requests;
+    uint64_t handlerBefore = server.handlerNanos;
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; c++)
+      threads.push_back(std::thread([&, c]() {
+        for (int i = c; i < requests; i += clients)
+        {
+          Clock::time_point sent = Clock::now();
+          if (httpGet(port, endpoint.path) == expected)
+            micros[c].push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+          else
+            failures++;
+        }
+      }));
+    for (std::thread &thread : threads)
+      thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    usleep(50000); // let the server finish closing
+
+    std::vector<double> all;
+    for (const std::vector<double> &times : micros)
+      all.insert(all.end(), times.begin(), times.end());
+    std::sort(all.begin(), all.end());
+    unsigned served = server.requests - requestsBefore;
+    printf("%-14s %9.0f %10.1f %10.1f %14.2f %7d\n", endpoint.name, requests / seconds, all.empty() ? 0 : all[all.size() / 2], all.empty() ? 0 : all[std::min(all.size() - 1, all.size() * 99 / 100)], served ? (server.handlerNanos - handlerBefore) / 1e3 / served : 0, (int)failures);
+    failed = failed || failures;
+  }
+
+  usleep(100000);
+  server.stop = true;
+  serverThread.join();
+  shutdown(streamFd, SHUT_RDWR);
+  streamThread.join();
+  close(streamFd);
+
+  unsigned streamEvents = eventsReceived ? eventsReceived - 1 : 0; // the first blank line ends "retry: 2000"
+  printf("\nevents: %u enqueued, %u sent down the stream, %u received, %u dropped (stream's send buffer full)\n", server.enqueued, server.broadcasts - server.dropped, streamEvents, server.dropped);
+  printf("503 busy: %u\n", server.busy);
+  printf("allocations while handling requests: %u\n", handlerAllocations.load());
+  return failed || handlerAllocations ? 1 : 0;
+}
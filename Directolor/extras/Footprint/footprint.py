@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+#
+#  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+#  Copyright (c) 2022 Jason Loucks.  All right reserved.
+#
+#  This library is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU Lesser General Public
+#  License as published by the Free Software Foundation; either
+#  version 2.1 of the License, or (at your option) any later version.
+#  This library is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+#  Lesser General Public License for more details.
+"""
+Static RAM, flash and stack per subsystem of a Directolor build - to keep an eye on the footprint, and to catch a change that grows it.
+
+Build the sketch with stack usage and call graph output kept (the call graph needs GCC 10 or later - the esp32 core 3.x toolchain):
+  arduino-cli compile -b esp32:esp32:esp32 --build-path build \\
+    --build-property "compiler.cpp.extra_flags=-fstack-usage -fcallgraph-info=su" examples/Directolor
+
+Then:
+  footprint.py --elf build/Directolor.ino.elf --stack build                report
+  footprint.py --elf build/Directolor.ino.elf --stack build --save base.json
+  footprint.py --elf build/Directolor.ino.elf --stack build --baseline base.json [--tolerance 64]
+                                                                         report, and exit 1 if any subsystem grew by more than
+                                                                         --tolerance bytes (RAM, flash or peak stack)
+
+--nm defaults to xtensa-esp32-elf-nm (on the path, or in the esp32 core's tools folder) - give --nm nm for a PC build.
+
+RAM is .data + .bss, flash is code, constants and the initial values of .data.  Symbols are put in a subsystem by the source file
+they came from (which needs the debug info arduino-cli builds with), or by name if there isn't any.
+
+Stack: "frame" is the biggest single function frame in the subsystem.  "peak" is the deepest chain of calls starting in the
+subsystem, frames added up along the call graph - calls into code built without -fcallgraph-info (the core, FreeRTOS, RF24 if it's
+a precompiled library) count as zero, and a chain through recursion or a function pointer is cut there and marked with a +.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+# first match wins - (name, source file pattern, symbol name pattern)
+SUBSYSTEMS = [
+    ("cluster", r"(DirectolorCluster|ControlCluster)\.", r"DirectolorCluster|ControlCluster"),
+    ("udp", r"(DirectolorUdp|ControlUdp)\.", r"DirectolorUdp|ControlUdp|directolorUdp"),
+    ("control plane", r"Control(Plane|Page|Request|Connection|Coalesce)\.", r"ControlPlane|ControlRequest|ControlConnection|ControlCoalescer|controlPage|controlPath"),
+    ("protocol", r"DirectolorProtocol\.", r"^directolor|DirectolorRemoteMatcher|DirectolorFrame"),
+    ("cover", r"DirectolorCover\.", r"Cover433mhz|Directolor_Cover"),
+    ("core", r"Directolor\.(cpp|h)", r"Directolor"),
+    ("sketch", r"\.ino", r"^(setup|loop)\("),
+]
+OTHER = "other"
+
+
+def subsystem(source, name):
+    for subsystemName, sourcePattern, namePattern in SUBSYSTEMS:
+        if source and re.search(sourcePattern, os.path.basename(source)):
+            return subsystemName
+    if source and not source.startswith("??"):
+        return OTHER  # framework / library code
+    for subsystemName, sourcePattern, namePattern in SUBSYSTEMS:
+        if re.search(namePattern, name):
+            return subsystemName
+    return OTHER
+
+
+def find_nm(nm):
+    if nm and (os.path.isfile(nm) or shutil.which(nm)):
+        return nm
+    for root in [os.path.expanduser("~/.arduino15/packages/esp32/tools"), os.path.expanduser("~/Library/Arduino15/packages/esp32/tools")]:
+        for directory, _, files in os.walk(root):
+            if "xtensa-esp32-elf-nm" in files:
+                return os.path.join(directory, "xtensa-esp32-elf-nm")
+    sys.exit("can't find %s - give the path with --nm" % nm)
+
+
+def symbol_sizes(elf, nm):
+    # nm -S -C -l: address size type name [\tfile:line]
+    output = subprocess.run([find_nm(nm), "-S", "-C", "-l", "--size-sort", elf], capture_output=True, text=True, check=True).stdout
+    ram = {}
+    flash = {}
+    for line in output.splitlines():
+        fields = line.split(" ", 3)
+        if len(fields) < 4:
+            continue
+        size = int(fields[1], 16)
+        kind = fields[2].lower()
+        name, _, location = fields[3].partition("\t")
+        where = subsystem(location.rsplit(":", 1)[0], name)
+        if kind in "bdv" or kind == "s":  # .bss / .data (.data also takes flash for its initial values)
+            ram[where] = ram.get(where, 0) + size
+        if kind in "tdrwv":
+            flash[where] = flash.get(where, 0) + size
+    return ram, flash
+
+
+def read_stack_usage(directory):
+    frames = {}  # function -> (subsystem, bytes, bounded)
+    for root, _, files in os.walk(directory):
+        for fileName in files:
+            if not fileName.endswith(".su"):
+                continue
+            with open(os.path.join(root, fileName), errors="replace") as su:
+                for line in su:
+                    location, _, rest = line.rstrip("\n").partition("\t")
+                    size, _, qualifier = rest.partition("\t")
+                    parts = location.split(":", 3)
+                    if len(parts) < 4 or not size.isdigit():
+                        continue
+                    function = parts[3]
+                    frames[(parts[0], function)] = (subsystem(parts[0], function), int(size), "dynamic" not in qualifier or "bounded" in qualifier)
+    return frames
+
+
+NODE = re.compile(r'node: \{ title: "([^"]*)" label: "([^"]*)"')
+EDGE = re.compile(r'edge: \{ sourcename: "([^"]*)" targetname: "([^"]*)"')
+
+
+def read_call_graph(directory):
+    nodes = {}  # title -> (subsystem, name, bytes or None)
+    edges = {}
+    for root, _, files in os.walk(directory):
+        for fileName in files:
+            if not fileName.endswith(".ci"):
+                continue
+            with open(os.path.join(root, fileName), errors="replace") as ci:
+                for line in ci:
+                    node = NODE.search(line)
+                    if node:
+                        label = node.group(2).split("\\n")
+                        frame = re.match(r"(\d+) bytes", label[2]) if len(label) > 2 else None
+                        if frame or node.group(1) not in nodes:  # a definition beats the external declaration another file saw
+                            source = label[1].split(":")[0] if len(label) > 1 else ""
+                            nodes[node.group(1)] = (subsystem(source, label[0]), label[0], int(frame.group(1)) if frame else None)
+                        continue
+                    edge = EDGE.search(line)
+                    if edge:
+                        edges.setdefault(edge.group(1), set()).add(edge.group(2))
+    return nodes, edges
+
+
+def peak_stacks(nodes, edges):
+    memo = {}
+
+    def peak(title, path):
+        if title in memo:
+            return memo[title]
+        if title in path:
+            return 0, True  # recursion - cut
+        own = nodes.get(title, (None, None, None))[2] or 0
+        deepest, cut = 0, False
+        path.add(title)
+        for callee in edges.get(title, ()):
+            depth, calleeCut = peak(callee, path)
+            cut = cut or calleeCut
+            deepest = max(deepest, depth)
+        path.discard(title)
+        if title.startswith("__indirect_call"):
+            cut = True
+        memo[title] = (own + deepest, cut)
+        return memo[title]
+
+    sys.setrecursionlimit(10000)
+    peaks = {}
+    for title, (where, name, frame) in nodes.items():
+        if frame is None:
+            continue
+        depth, cut = peak(title, set())
+        if depth > peaks.get(where, (0, "", False))[0]:
+            peaks[where] = (depth, name, cut)
+    return peaks
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--elf", help="the linked sketch (arduino-cli puts it in --build-path)")
+    parser.add_argument("--stack", help="build directory holding the .su / .ci files")
+    parser.add_argument("--nm", default="xtensa-esp32-elf-nm")
+    parser.add_argument("--save", help="write the figures to this JSON file")
+    parser.add_argument("--baseline", help="compare with figures saved by --save")
+    parser.add_argument("--tolerance", type=int, default=0, help="bytes a figure can grow before it counts as a regression")
+    args = parser.parse_args()
+    if not args.elf and not args.stack:
+        parser.error("give --elf, --stack or both")
+
+    report = {}
+
+    def entry(where):
+        return report.setdefault(where, {"ram": 0, "flash": 0, "frame": 0, "peak": 0})
+
+    if args.elf:
+        ram, flash = symbol_sizes(args.elf, args.nm)
+        for where, size in ram.items():
+            entry(where)["ram"] = size
+        for where, size in flash.items():
+            entry(where)["flash"] = size
+
+    notes = {}
+    if args.stack:
+        for (source, function), (where, size, bounded) in read_stack_usage(args.stack).items():
+            if size > entry(where)["frame"]:
+                entry(where)["frame"] = size
+                notes.setdefault(where, {})["frame"] = function + ("" if bounded else " (unbounded dynamic allocation)")
+        nodes, edges = read_call_graph(args.stack)
+        for where, (depth, name, cut) in peak_stacks(nodes, edges).items():
+            entry(where)["peak"] = depth
+            notes.setdefault(where, {})["peak"] = name + (" (+ cut at recursion / indirect call)" if cut else "")
+
+    order = [name for name, _, _ in SUBSYSTEMS] + [OTHER]
+    print("%-14s %8s %8s %7s %7s" % ("subsystem", "ram", "flash", "frame", "peak"))
+    for where in order:
+        if where in report:
+            figures = report[where]
+            print("%-14s %8d %8d %7d %7d" % (where, figures["ram"], figures["flash"], figures["frame"], figures["peak"]))
+    for where in order:
+        for kind, name in sorted(notes.get(where, {}).items()):
+            print("  %s %s: %s" % (where, kind, name))
+
+    if args.save:
+        with open(args.save, "w") as out:
+            json.dump(report, out, indent=2, sort_keys=True)
+
+    if args.baseline:
+        with open(args.baseline) as baselineFile:
+            baseline = json.load(baselineFile)
+        regressions = 0
+        for where in order:
+            for kind in ("ram", "flash", "frame", "peak"):
+                before = baseline.get(where, {}).get(kind, 0)
+                after = report.get(where, {}).get(kind, 0)
+                if after != before:
+                    regressed = after - before > args.tolerance
+                    regressions += regressed
+                    print("%s %-14s %-5s %8d -> %8d (%+d)" % ("REGRESSION" if regressed else "changed   ", where, kind, before, after, after - before))
+        if regressions:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
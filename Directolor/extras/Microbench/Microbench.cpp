@@ -0,0 +1,294 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+/**
+   Times the encode, CRC, padding, decode, matcher and queue kernels (examples/Microbench/MicrobenchKernels.h) on a PC, and compares
+   results - from here or from the Microbench sketch on an ESP32 - against a stored baseline.
+
+   Build (Linux / macOS):
+     g++ -O2 -I../.. -I../../examples/Microbench Microbench.cpp -o Microbench
+
+   Usage:
+     Microbench [--filter NAME] [--time MS] [--samples N]       time every kernel (or those whose name contains NAME)
+                [--save FILE]                                   and write the results as JSON
+                [--baseline FILE] [--threshold PCT]             and compare with saved results - exits 1 on a regression
+     Microbench --compare BASELINE RESULTS [--threshold PCT]    compare two saved results (e.g. JSON copied from the sketch's output)
+
+   Each kernel is run in samples of about --time ms (default 50, iterations picked to fit), a sample of each kernel in turn, and the
+   fastest of --samples (default 7) is reported as ns/op and cycles/op.  Cycles are the time stamp counter on x86, which ticks at a fixed rate rather than with the
+   core clock - compare them between runs on the same machine, not with the ESP32's.  A kernel is a regression when it's more than
+   --threshold percent (default 25) slower than the baseline - in cycles when both results have them, otherwise in ns.
+
+   Two runs of an unchanged build can differ by more than 10% (frequency scaling, other work on the machine), so with --baseline a
+   slower kernel is timed again and only counts as a regression if it is slower both times.  --compare only has the two files to go
+   on - take both on the same idle machine.
+*/
+
+#include "MicrobenchKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICROBENCH_CYCLES() __rdtsc()
+#else
+#define MICROBENCH_CYCLES() 0
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result
+{
+  double ns;
+  double cycles;
+};
+
+typedef std::map<std::string, Result> Results;
+
+static volatile uint32_t sink; // checksums end up here, so the kernels' work is used
+
+static uint32_t calibrate(const MicrobenchKernel &kernel, unsigned timeMs) // iterations that take about timeMs
+{
+  uint32_t iterations = 16;
+  for (;;)
+  {
+    Clock::time_point start = Clock::now();
+    sink += kernel.run(iterations);
+    double elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    if (elapsedMs >= timeMs / 4.0 || iterations >= 0x40000000)
+      return (uint32_t)std::min(4e9, std::max(1.0, iterations * timeMs / std::max(elapsedMs, 1e-3)));
+    iterations *= 4;
+  }
+}
+
+static Result sample(const MicrobenchKernel &kernel, uint32_t iterations)
+{
+  uint64_t startCycles = MICROBENCH_CYCLES();
+  Clock::time_point start = Clock::now();
+  sink += kernel.run(iterations);
+  Clock::time_point end = Clock::now();
+  uint64_t endCycles = MICROBENCH_CYCLES();
+  Result result = {std::chrono::duration<double, std::nano>(end - start).count() / iterations, (double)(endCycles - startCycles) / iterations};
+  return result;
+}
+
+// Times the kernels in rounds - each kernel once a round - and keeps each one's fastest sample (interference from the rest of the
+// machine only ever adds time).  Interleaved rather than a kernel at a time, so a busy stretch costs every kernel one slow sample
+// instead of costing one kernel all of them.
+static void timeKernels(const std::vector<unsigned> &kernels, unsigned timeMs, unsigned samples, Results &results)
+{
+  std::vector<uint32_t> iterations;
+  for (size_t k = 0; k < kernels.size(); k++)
+    iterations.push_back(calibrate(microbenchKernels[kernels[k]], timeMs));
+
+  for (unsigned i = 0; i < samples; i++)
+    for (size_t k = 0; k < kernels.size(); k++)
+    {
+      const char *name = microbenchKernels[kernels[k]].name;
+      Result result = sample(microbenchKernels[kernels[k]], iterations[k]);
+      Results::iterator fastest = results.find(name);
+      if (fastest == results.end())
+        results[name] = result;
+      else
+      {
+        fastest->second.ns = std::min(fastest->second.ns, result.ns);
+        fastest->second.cycles = std::min(fastest->second.cycles, result.cycles);
+      }
+    }
+}
+
+static bool save(const char *path, const char *platform, const Results &results)
+{
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return false;
+  fprintf(file, "{\"platform\":\"%s\",\"kernels\":{", platform);
+  bool first = true;
+  for (Results::const_iterator i = results.begin(); i != results.end(); ++i, first = false)
+    fprintf(file, "%s\n  \"%s\":{\"ns\":%.3f,\"cycles\":%.2f}", first ? "" : ",", i->first.c_str(), i->second.ns, i->second.cycles);
+  fprintf(file, "\n}}\n");
+  return fclose(file) == 0;
+}
+
+// Reads what save() (or the sketch) wrote - anything before the JSON, e.g. the rest of a serial log, is skipped.
+static bool load(const char *path, Results &results)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return false;
+  std::string text;
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    text.append(buffer, length);
+  fclose(file);
+
+  size_t at = text.find("\"kernels\"");
+  if (at == std::string::npos || (at = text.find('{', at)) == std::string::npos)
+    return false;
+  for (;;)
+  {
+    size_t nameStart = text.find('"', at + 1);
+    size_t close = text.find('}', at + 1);
+    if (nameStart == std::string::npos || close < nameStart)
+      break;
+    size_t nameEnd = text.find('"', nameStart + 1);
+    size_t objectEnd = text.find('}', nameEnd);
+    if (nameEnd == std::string::npos || objectEnd == std::string::npos)
+      return false;
+    std::string object = text.substr(nameEnd, objectEnd - nameEnd);
+    size_t ns = object.find("\"ns\":");
+    size_t cycles = object.find("\"cycles\":");
+    Result result = {ns == std::string::npos ? 0 : atof(object.c_str() + ns + 5), cycles == std::string::npos ? 0 : atof(object.c_str() + cycles + 9)};
+    results[text.substr(nameStart + 1, nameEnd - nameStart - 1)] = result;
+    at = objectEnd;
+  }
+  return !results.empty();
+}
+
+// Percent slower than the baseline - in cycles when both have them, otherwise in ns.
+static double slowdown(const Result &was, const Result &now, bool &cycles)
+{
+  cycles = was.cycles > 0 && now.cycles > 0;
+  double before = cycles ? was.cycles : was.ns;
+  double after = cycles ? now.cycles : now.ns;
+  return before > 0 ? (after - before) / before * 100 : 0;
+}
+
+static int compare(const Results &baseline, const Results &results, double threshold)
+{
+  int regressions = 0;
+  printf("\n%-16s %12s %12s %8s\n", "kernel", "baseline", "now", "change");
+  for (Results::const_iterator i = results.begin(); i != results.end(); ++i)
+  {
+    Results::const_iterator before = baseline.find(i->first);
+    if (before == baseline.end())
+    {
+      printf("%-16s %12s %12s %8s\n", i->first.c_str(), "-", "", "new");
+      continue;
+    }
+    bool cycles;
+    double change = slowdown(before->second, i->second, cycles);
+    double was = cycles ? before->second.cycles : before->second.ns;
+    double now = cycles ? i->second.cycles : i->second.ns;
+    bool regressed = change > threshold;
+    regressions += regressed;
+    printf("%-16s %9.2f %-2s %9.2f %-2s %+7.1f%%%s\n", i->first.c_str(), was, cycles ? "cy" : "ns", now, cycles ? "cy" : "ns", change, regressed ? "  REGRESSION" : "");
+  }
+  for (Results::const_iterator i = baseline.begin(); i != baseline.end(); ++i)
+    if (!results.count(i->first))
+      printf("%-16s %12s %12s %8s\n", i->first.c_str(), "", "-", "missing");
+  if (regressions)
+    printf("\n%d kernel(s) more than %.0f%% slower\n", regressions, threshold);
+  return regressions ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  const char *filter = 0;
+  const char *savePath = 0;
+  const char *baselinePath = 0;
+  const char *comparePaths[2] = {0, 0};
+  unsigned timeMs = 50;
+  unsigned samples = 7;
+  double threshold = 25;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--filter") && i + 1 < argc)
+      filter = argv[++i];
+    else if (!strcmp(argv[i], "--time") && i + 1 < argc)
+      timeMs = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--samples") && i + 1 < argc)
+      samples = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--save") && i + 1 < argc)
+      savePath = argv[++i];
+    else if (!strcmp(argv[i], "--baseline") && i + 1 < argc)
+      baselinePath = argv[++i];
+    else if (!strcmp(argv[i], "--threshold") && i + 1 < argc)
+      threshold = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--compare") && i + 2 < argc)
+    {
+      comparePaths[0] = argv[++i];
+      comparePaths[1] = argv[++i];
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [--filter NAME] [--time MS] [--samples N] [--save FILE] [--baseline FILE] [--threshold PCT]\n"
+                      "       %s --compare BASELINE RESULTS [--threshold PCT]\n",
+              argv[0], argv[0]);
+      return 2;
+    }
+  }
+
+  if (comparePaths[0])
+  {
+    Results baseline, results;
+    if (!load(comparePaths[0], baseline) || !load(comparePaths[1], results))
+    {
+      fprintf(stderr, "can't read results from %s / %s\n", comparePaths[0], comparePaths[1]);
+      return 2;
+    }
+    return compare(baseline, results, threshold);
+  }
+
+  Results baseline;
+  if (baselinePath && !load(baselinePath, baseline))
+  {
+    fprintf(stderr, "can't read results from %s\n", baselinePath);
+    return 2;
+  }
+
+  std::vector<unsigned> kernels;
+  for (unsigned i = 0; i < MICROBENCH_KERNEL_COUNT; i++)
+    if (!filter || strstr(microbenchKernels[i].name, filter))
+      kernels.push_back(i);
+
+  Results results;
+  timeKernels(kernels, timeMs, samples, results);
+
+  // Anything slower than the baseline is timed again (the others with it, to keep the rounds interleaved) and keeps the faster of
+  // the two, so it only counts as a regression if it is slower both times.
+  for (Results::const_iterator i = results.begin(); i != results.end(); ++i)
+  {
+    Results::const_iterator before = baseline.find(i->first);
+    bool cycles;
+    if (before != baseline.end() && slowdown(before->second, i->second, cycles) > threshold)
+    {
+      printf("%s is slower than the baseline - timing again\n", i->first.c_str());
+      timeKernels(kernels, timeMs, samples, results);
+      break;
+    }
+  }
+
+  printf("%-16s %10s %10s\n", "kernel", "ns/op", "cycles/op");
+  for (size_t k = 0; k < kernels.size(); k++)
+  {
+    const Result &result = results[microbenchKernels[kernels[k]].name];
+    printf("%-16s %10.2f %10.2f\n", microbenchKernels[kernels[k]].name, result.ns, result.cycles);
+  }
+
+  if (savePath && !save(savePath, "host", results))
+  {
+    fprintf(stderr, "can't write %s\n", savePath);
+    return 2;
+  }
+  return baselinePath ? compare(baseline, results, threshold) : 0;
+}
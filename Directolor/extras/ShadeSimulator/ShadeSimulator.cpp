@@ -0,0 +1,528 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+/**
+   Simulates a house full of Levolor shade receivers listening to Directolor, so MESSAGE_SEND_RETRIES, MESSAGE_SEND_ATTEMPTS and
+   INTERMESSAGE_SEND_DELAY can be tuned without climbing ladders.
+
+   Build (Linux / macOS):
+     g++ -O2 -I../.. ShadeSimulator.cpp -o ShadeSimulator
+
+   Usage:
+     ShadeSimulator [options]            sweep retries x attempts x delay and report the cheapest settings that reach --target
+     ShadeSimulator --retries 513 --attempts 3 --delay 170 [options]    simulate one setting
+
+   Transmitter - follows processLoop(): commands are queued with the library's directolorEnqueue() (merging, superseding) into
+   DIRECTOLOR_MAX_QUEUED_COMMANDS slots walked round robin, each burst is preceded by the 20ms power up delay, frames are built with the
+   library's frame builders, CRC'd and 0x55 padded exactly as they are sent, and bursts are INTERMESSAGE_SEND_DELAY apart.
+
+   Receiver - a shade sleeps and wakes every --wake ms (+/- --drift, --jitter) for a --listen ms sniff.  If it hears a packet during the sniff it stays awake,
+   needs --train ms of packets to lock on to the 0x55 preamble and then tries every packet until the burst ends.  Each packet can be
+   lost outright (--loss), collide with another transmitter or get bit errors (--ber); what survives is checked the way the receiver
+   would - preamble, C0 marker, CRC, remote code and channel.  A decoded command drives a virtual motor.
+
+   Collisions - other transmitters (remotes, neighbours' controllers) start bursts of --other-burst ms at random, often enough to be on
+   the air --interference of the time.  Every packet that overlaps one of their bursts is lost, so a collision takes out a run of
+   packets, not scattered ones.
+
+   Because the sniff is periodic, how far apart the attempts of one command land matters as much as how long each burst is - if the
+   round robin brings a command back after close to a whole number of wake periods, every attempt hits the same part of the cycle.
+   That makes the sweep uneven - a setting can do well only because its spacing happens to suit --wake - so a setting is only
+   recommended if it also reaches --target with the wake period 10% shorter and 10% longer.
+
+   Calibration - the receiver timings can't be measured without opening a shade, so the defaults are fitted to the one thing known
+   about real ones: the library's settings (513 / 3 / 170) work in the field, and the Directolor.h comment that fewer than about 400
+   retries gets unreliable.  A 200ms wake period gives both - with it 513 / 3 / 170 delivers 100%, 384 about 99% and 256 about 90%
+   (a burst shorter than the wake period can fall between two sniffs).  The 500ms it used to default to had the shipped settings
+   missing a third of commands, which they don't.  If you do calibrate --wake / --listen / --train against your own shades
+   (extras/CaptureReplay helps), trust the sweep over the defaults.
+*/
+
+#include "DirectolorProtocol.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define REMOTE_CHANNELS 6
+#define WAKE_MARGIN 0.1 // a recommended setting has to reach the target with the wake period this much shorter and longer too
+
+struct Options
+{
+  int shades = 36;
+  int trials = 40;
+  double target = 0.99;
+  double loss = 0.02;
+  double interference = 0.05; // fraction of the time another transmitter is on the air
+  double otherBurstMs = 250;  // how long each of its bursts lasts - about a remote press, or another Directolor's burst
+  double ber = 1e-4;
+  double wakeMs = 200; // see Calibration above
+  double drift = 0.02;  // shades run on RC oscillators - each one's wake period is off by up to this fraction
+  double jitter = 0.05; // ... and each individual wake up wanders by up to this fraction of the period
+  double listenMs = 4;
+  double trainMs = 1.5;
+  double packetUs = 297;  // 1 byte preamble + 3 byte address + 32 byte payload + 9 bit packet control at 1Mbps
+  double overheadUs = 160; // writeFast + txStandBy: SPI upload and the 130us PLL settle before every packet
+  double fullTravelS = 20;
+  const char *scenario = "each";
+  int retries = -1; // -1 - not given
+  int attempts = -1;
+  int delay = -1;
+  unsigned seed = 1;
+};
+
+struct Shade
+{
+  uint8_t remote;   // index into remoteCodes
+  uint8_t channel;  // 0 based
+  double nextWake;   // ms - start of the next sniff window
+  double wakePeriod; // ms
+  double position;  // 0 closed - 100 open
+  double moveStart;
+  int direction; // -1 closing, 0 stopped, 1 opening
+  double deliveredAt[2]; // per command in the scenario, -1 if never
+};
+
+struct Result
+{
+  int retries, attempts, delay;
+  double airtimeMs;  // total transmit time (radio powered up)
+  double delivery;   // fraction of shade commands decoded
+  double latencyMs;  // mean enqueue -> decode
+  double completeMs; // mean time until the queue is empty
+  double stopErrorPct; // timed scenario only - mean |position - intended|
+};
+
+static const uint8_t remoteCodes[][4] = {{0x12, 0xF0, 0x78, 0x09}, {0x11, 0x11, 0xB9, 0x7B}, {0x13, 0x7C, 0xBE, 0x09}, {0x07, 0xB5, 0xCC, 0x83}, {0x52, 0xC7, 0x75, 0xA9}, {0x6F, 0xF1, 0xEE, 0xB7}, {0x56, 0x13, 0x04, 0x67}};
+#define REMOTE_COUNT (sizeof(remoteCodes) / sizeof(remoteCodes[0]))
+#define QUEUE_SIZE (REMOTE_COUNT * 2) // DIRECTOLOR_MAX_QUEUED_COMMANDS
+
+class Simulator
+{
+public:
+  Simulator(const Options &options, int retries, int attempts, int delay, double wakeMs = 0)
+      : o(options), retries(retries), attempts(attempts), delay(delay), wakeMs(wakeMs ? wakeMs : options.wakeMs), rng(options.seed) {}
+
+  Result run()
+  {
+    Result result = {retries, attempts, delay, 0, 0, 0, 0, 0};
+    int delivered = 0, expected = 0, stops = 0;
+    double latency = 0;
+
+    for (int trial = 0; trial < o.trials; trial++)
+    {
+      setup();
+      simulate();
+
+      result.airtimeMs += airtime;
+      result.completeMs += queueEmptyAt;
+      for (size_t i = 0; i < shades.size(); i++)
+        for (int c = 0; c < scenarioCommands; c++)
+        {
+          expected++;
+          if (shades[i].deliveredAt[c] >= 0)
+          {
+            delivered++;
+            latency += shades[i].deliveredAt[c] - commandEnqueueAt[c];
+          }
+        }
+      if (!strcmp(o.scenario, "timed"))
+        for (size_t i = 0; i < shades.size(); i++)
+        {
+          settle(shades[i], 1e9);
+          result.stopErrorPct += fabs(shades[i].position - timedTargetPct);
+          stops++;
+        }
+    }
+
+    result.airtimeMs /= o.trials;
+    result.completeMs /= o.trials;
+    result.delivery = expected ? (double)delivered / expected : 0;
+    result.latencyMs = delivered ? latency / delivered : 0;
+    result.stopErrorPct = stops ? result.stopErrorPct / stops : 0;
+    return result;
+  }
+
+private:
+  const Options &o;
+  int retries, attempts, delay;
+  double wakeMs;
+  std::mt19937 rng;
+  std::vector<Shade> shades;
+  DirectolorQueueEntry queue[QUEUE_SIZE]; // remote is 1 based, as in the library
+  int queueScenario[QUEUE_SIZE];          // which deliveredAt slot each entry fills
+  std::vector<double> otherBursts;        // start times of other transmitters' bursts, generated as far as they've been asked about
+  int scenarioCommands;
+  double commandEnqueueAt[2];
+  double airtime;
+  double queueEmptyAt;
+  double timedTargetPct;
+
+  double uniform() { return std::uniform_real_distribution<double>(0, 1)(rng); }
+
+  void setup()
+  {
+    shades.clear();
+    memset(queue, 0, sizeof(queue));
+    otherBursts.assign(1, -o.otherBurstMs * uniform());
+    for (int i = 0; i < o.shades; i++)
+    {
+      Shade shade;
+      shade.remote = (i / REMOTE_CHANNELS) % REMOTE_COUNT;
+      shade.channel = i % REMOTE_CHANNELS;
+      shade.nextWake = uniform() * wakeMs;
+      shade.wakePeriod = wakeMs * (1 + o.drift * (2 * uniform() - 1));
+      shade.position = 0;
+      shade.moveStart = 0;
+      shade.direction = 0;
+      shade.deliveredAt[0] = shade.deliveredAt[1] = -1;
+      shades.push_back(shade);
+    }
+
+    // "each" - one open per shade, as a hub sending one request per shade does.  "all" - one multi channel open per remote.
+    // "timed" - open each shade then stop it after 40% of its travel, the way DirectolorCover does partial positions.
+    scenarioCommands = 1;
+    commandEnqueueAt[0] = 0;
+    if (!strcmp(o.scenario, "all"))
+    {
+      uint8_t masks[REMOTE_COUNT] = {0};
+      for (size_t i = 0; i < shades.size(); i++)
+        masks[shades[i].remote] |= 1 << shades[i].channel;
+      for (size_t r = 0; r < REMOTE_COUNT; r++)
+        if (masks[r])
+          enqueue(r, masks[r], directolor_open, 0);
+    }
+    else
+    {
+      for (size_t i = 0; i < shades.size(); i++)
+        enqueue(shades[i].remote, 1 << shades[i].channel, directolor_open, 0);
+      if (!strcmp(o.scenario, "timed"))
+      {
+        timedTargetPct = 40;
+        scenarioCommands = 2;
+        commandEnqueueAt[1] = o.fullTravelS * 1000 * timedTargetPct / 100;
+      }
+    }
+  }
+
+  void enqueue(uint8_t remote, uint8_t channels, uint8_t action, int scenarioIndex) // what sendMultiChannelCode() does - a full queue drops the command
+  {
+    DirectolorQueueEntry *entry = directolorEnqueue(queue, QUEUE_SIZE, remote + 1, channels, action, attempts);
+    if (entry)
+      queueScenario[entry - queue] = scenarioIndex;
+  }
+
+  bool collides(double from, double to) // does [from, to) overlap another transmitter's burst
+  {
+    if (o.interference <= 0)
+      return false;
+    double rate = -log(1 - o.interference) / o.otherBurstMs; // bursts per ms that keep the air busy that fraction of the time
+    while (otherBursts.back() < to)
+      otherBursts.push_back(otherBursts.back() + std::exponential_distribution<double>(rate)(rng));
+    // the bursts are all the same length, so the last one to start before to is the last one to end
+    std::vector<double>::iterator last = std::lower_bound(otherBursts.begin(), otherBursts.end(), to);
+    return last != otherBursts.begin() && *(last - 1) + o.otherBurstMs > from;
+  }
+
+  void settle(Shade &shade, double now) // advance the motor to now
+  {
+    if (shade.direction)
+    {
+      shade.position += shade.direction * (now - shade.moveStart) / (o.fullTravelS * 10);
+      shade.position = std::min(100.0, std::max(0.0, shade.position));
+      shade.moveStart = now;
+      if (shade.position == 0 || shade.position == 100)
+        shade.direction = 0;
+    }
+  }
+
+  void deliver(Shade &shade, const DirectolorQueueEntry &command, int scenarioIndex, double now)
+  {
+    if (shade.deliveredAt[scenarioIndex] >= 0)
+      return; // later attempts of a command the shade already acted on change nothing
+    shade.deliveredAt[scenarioIndex] = now;
+    settle(shade, now);
+    shade.moveStart = now;
+    shade.direction = command.blindAction == directolor_open ? 1 : command.blindAction == directolor_close ? -1 : 0;
+  }
+
+  void advanceWake(Shade &shade)
+  {
+    shade.nextWake += shade.wakePeriod * (1 + o.jitter * (2 * uniform() - 1));
+  }
+
+  bool packetSurvives(uint8_t *packet, const DirectolorQueueEntry &command, double at)
+  {
+    if (uniform() < o.loss || collides(at, at + o.packetUs / 1000))
+      return false;
+    if (o.ber > 0)
+    {
+      int bits = MAX_PAYLOAD_SIZE * 8;
+      std::binomial_distribution<int> flips(bits, o.ber);
+      for (int n = flips(rng); n > 0; n--)
+      {
+        int bit = rng() % bits;
+        packet[bit / 8] ^= 1 << (bit % 8);
+      }
+    }
+
+    int8_t start = directolorCheckFrame(packet, MAX_PAYLOAD_SIZE);
+    if (start < 0)
+      return false;
+    // remote id is the receiver's address match, the rest is what the library's capture mode sees
+    const uint8_t *radioCode = remoteCodes[command.remote - 1];
+    if (packet[start] != radioCode[0] || packet[start + 1] != radioCode[1])
+      return false;
+    DirectolorFrame frame;
+    if (!directolorDecodeFrame(packet + start + 3, MAX_PAYLOAD_SIZE - start - 3, frame) || frame.type != directolor_frameCommand)
+      return false;
+    return frame.radioCode[0] == radioCode[2] && frame.radioCode[1] == radioCode[3] && frame.action == command.blindAction && frame.channels == command.channels;
+  }
+
+  void burst(const DirectolorQueueEntry &command, int scenarioIndex, double start)
+  {
+    uint8_t frame[MAX_PAYLOAD_SIZE];
+    uint8_t length = directolorBuildCommandFrame(frame, remoteCodes[command.remote - 1], command.channels, command.blindAction, rng());
+    directolorFinishFrame(frame, length);
+
+    double period = (o.packetUs + o.overheadUs) / 1000;
+    double first = start + DIRECTOLOR_POWER_UP_DELAY_MS;
+    double end = first + retries * period;
+    airtime += end - start;
+
+    for (size_t s = 0; s < shades.size(); s++)
+    {
+      Shade &shade = shades[s];
+      if (shade.remote != command.remote - 1 || !(command.channels & (1 << shade.channel)) || shade.deliveredAt[scenarioIndex] >= 0)
+        continue;
+
+      // first sniff window that overlaps a packet of this burst
+      while (shade.nextWake + o.listenMs <= first)
+        advanceWake(shade);
+      double heard = -1;
+      for (; shade.nextWake < end; advanceWake(shade))
+      {
+        double from = std::max(shade.nextWake, first);
+        double to = shade.nextWake + o.listenMs;
+        if (to <= from)
+          continue;
+        int packet = (int)ceil((from - first) / period); // a packet has to start inside the window to be heard
+        if (first + packet * period < to && packet < retries)
+        {
+          heard = first + packet * period;
+          break;
+        }
+      }
+      if (heard < 0)
+        continue;
+
+      for (int packet = (int)ceil((heard + o.trainMs - first) / period); packet < retries; packet++)
+      {
+        uint8_t received[MAX_PAYLOAD_SIZE];
+        memcpy(received, frame, sizeof(received));
+        double at = first + packet * period;
+        if (packetSurvives(received, command, at))
+        {
+          deliver(shade, command, scenarioIndex, at + o.packetUs / 1000);
+          break;
+        }
+      }
+    }
+  }
+
+  void simulate()
+  {
+    airtime = 0;
+    double now = 0;
+    double lastSend = -1e9;
+    size_t next = 0;
+    bool stopsQueued = scenarioCommands < 2;
+
+    while (true)
+    {
+      if (!stopsQueued && now >= commandEnqueueAt[1])
+      {
+        for (size_t i = 0; i < shades.size(); i++)
+          enqueue(shades[i].remote, 1 << shades[i].channel, directolor_stop, 1);
+        stopsQueued = true;
+      }
+
+      size_t pending = 0;
+      for (size_t i = 0; i < QUEUE_SIZE; i++)
+        if (queue[i].remote)
+          pending++;
+      if (!pending)
+      {
+        if (stopsQueued)
+          break;
+        now = commandEnqueueAt[1];
+        continue;
+      }
+
+      while (!queue[next % QUEUE_SIZE].remote)
+        next++;
+      size_t slot = next++ % QUEUE_SIZE;
+      DirectolorQueueEntry &command = queue[slot];
+      now = std::max(now, lastSend + delay);
+      double start = now;
+      burst(command, queueScenario[slot], start);
+      now = start + DIRECTOLOR_POWER_UP_DELAY_MS + retries * (o.packetUs + o.overheadUs) / 1000;
+      lastSend = now;
+      if (--command.resendRemainingCount == 0)
+        command.remote = 0;
+    }
+    queueEmptyAt = now;
+  }
+};
+
+static void printResult(const Result &r, double target)
+{
+  printf("%7d %8d %6d %11.0f %9.2f%% %10.0f %11.0f", r.retries, r.attempts, r.delay, r.airtimeMs, r.delivery * 100, r.latencyMs, r.completeMs);
+  if (r.stopErrorPct)
+    printf(" %9.1f%%", r.stopErrorPct);
+  printf("%s\n", r.delivery >= target ? "  *" : "");
+}
+
+static void printHeader()
+{
+  printf("retries attempts  delay  airtime ms  delivered latency ms complete ms\n");
+}
+
+int main(int argc, char **argv)
+{
+  Options o;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : 0;
+    if (!value)
+    {
+      fprintf(stderr, "missing value for %s\n", arg);
+      return 2;
+    }
+    i++;
+    if (!strcmp(arg, "--shades"))
+      o.shades = atoi(value);
+    else if (!strcmp(arg, "--trials"))
+      o.trials = atoi(value);
+    else if (!strcmp(arg, "--target"))
+      o.target = atof(value);
+    else if (!strcmp(arg, "--loss"))
+      o.loss = atof(value);
+    else if (!strcmp(arg, "--interference"))
+      o.interference = atof(value);
+    else if (!strcmp(arg, "--other-burst"))
+      o.otherBurstMs = atof(value);
+    else if (!strcmp(arg, "--ber"))
+      o.ber = atof(value);
+    else if (!strcmp(arg, "--wake"))
+      o.wakeMs = atof(value);
+    else if (!strcmp(arg, "--drift"))
+      o.drift = atof(value);
+    else if (!strcmp(arg, "--jitter"))
+      o.jitter = atof(value);
+    else if (!strcmp(arg, "--listen"))
+      o.listenMs = atof(value);
+    else if (!strcmp(arg, "--train"))
+      o.trainMs = atof(value);
+    else if (!strcmp(arg, "--travel"))
+      o.fullTravelS = atof(value);
+    else if (!strcmp(arg, "--scenario"))
+      o.scenario = value;
+    else if (!strcmp(arg, "--retries"))
+      o.retries = atoi(value);
+    else if (!strcmp(arg, "--attempts"))
+      o.attempts = atoi(value);
+    else if (!strcmp(arg, "--delay"))
+      o.delay = atoi(value);
+    else if (!strcmp(arg, "--seed"))
+      o.seed = atoi(value);
+    else
+    {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if (strcmp(o.scenario, "each") && strcmp(o.scenario, "all") && strcmp(o.scenario, "timed"))
+  {
+    fprintf(stderr, "--scenario must be each, all or timed\n");
+    return 2;
+  }
+  if (o.interference < 0 || o.interference >= 1 || o.otherBurstMs <= 0)
+  {
+    fprintf(stderr, "--interference must be at least 0 and less than 1, --other-burst more than 0\n");
+    return 2;
+  }
+
+  printf("%d shades, scenario %s, %d trials, wake %.0fms (+/-%.0f%% drift, +/-%.0f%% jitter) listen %.1fms train %.1fms, loss %.3f interference %.3f (%.0fms bursts) ber %g\n\n", o.shades, o.scenario, o.trials, o.wakeMs, o.drift * 100, o.jitter * 100, o.listenMs, o.trainMs, o.loss, o.interference, o.otherBurstMs, o.ber);
+
+  if (o.retries >= 0 || o.attempts >= 0 || o.delay >= 0)
+  {
+    Simulator simulator(o, o.retries >= 0 ? o.retries : MESSAGE_SEND_RETRIES, o.attempts >= 0 ? o.attempts : MESSAGE_SEND_ATTEMPTS, o.delay >= 0 ? o.delay : (INTERMESSAGE_SEND_DELAY));
+    printHeader();
+    printResult(simulator.run(), o.target);
+    return 0;
+  }
+
+  static const int retrySweep[] = {32, 64, 128, 192, 256, 384, 513, 768, 1024, 1152, 1280};
+  static const int attemptSweep[] = {1, 2, 3, 4};
+  static const int delaySweep[] = {0, 50, 100, (INTERMESSAGE_SEND_DELAY), 250};
+
+  std::vector<Result> results;
+  for (int r : retrySweep)
+    for (int a : attemptSweep)
+      for (int d : delaySweep)
+      {
+        Simulator simulator(o, r, a, d);
+        results.push_back(simulator.run());
+      }
+
+  Simulator current(o, MESSAGE_SEND_RETRIES, MESSAGE_SEND_ATTEMPTS, (INTERMESSAGE_SEND_DELAY));
+  Result defaults = current.run();
+
+  std::sort(results.begin(), results.end(), [](const Result &a, const Result &b) { return a.airtimeMs < b.airtimeMs; });
+  printHeader();
+  for (const Result &r : results)
+    printResult(r, o.target);
+
+  printf("\ncurrent defaults:\n");
+  printHeader();
+  printResult(defaults, o.target);
+
+  int lucky = 0;
+  for (const Result &r : results)
+  {
+    if (r.delivery < o.target)
+      continue;
+    if (Simulator(o, r.retries, r.attempts, r.delay, o.wakeMs * (1 - WAKE_MARGIN)).run().delivery < o.target ||
+        Simulator(o, r.retries, r.attempts, r.delay, o.wakeMs * (1 + WAKE_MARGIN)).run().delivery < o.target)
+    {
+      lucky++; // only reaches the target because its spacing suits this exact wake period
+      continue;
+    }
+    printf("\ncheapest setting reaching %.2f%% (also with the wake period %.0f%% shorter and longer", o.target * 100, WAKE_MARGIN * 100);
+    printf(lucky ? " - %d cheaper ones only reach it at --wake):\n" : "):\n", lucky);
+    printHeader();
+    printResult(r, o.target);
+    printf("(%.0f%% of the airtime of the current defaults)\n", r.airtimeMs / defaults.airtimeMs * 100);
+    return 0;
+  }
+  printf("\nno setting reached %.2f%% with the wake period %.0f%% either side of --wake\n", o.target * 100, WAKE_MARGIN * 100);
+  return 1;
+}
@@ -0,0 +1,168 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+/**
+   Host side client for the binary UDP command protocol (DirectolorUdp.h) - header only, POSIX sockets (Linux / macOS).
+
+     DirectolorUdpClient client;
+     client.open("directolor.local");
+     DirectolorUdpCommand commands[] = {{1, 0x05, directolor_close}, {2, 0x01, directolor_open}};
+     DirectolorUdpResult results[2];
+     if (client.send(commands, 2, results))
+       printf("%s, %d ahead\n", directolorUdpStatusName(results[0].status), results[0].position);
+
+   send() waits for the ack and resends the same datagram (same sequence number) if it doesn't come, so a lost datagram costs
+   timeoutMs rather than the command.  The controller acks a resend without queueing the commands again.
+*/
+#ifndef _DirectolorUdpClient_h
+#define _DirectolorUdpClient_h
+
+#include "DirectolorUdp.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+struct DirectolorUdpCommand
+{
+  uint8_t remote;   // 1 based
+  uint8_t channels; // bit mask - channel 1 = bit 0
+  uint8_t action;   // BlindAction
+};
+
+struct DirectolorUdpResult
+{
+  uint8_t status;   // DirectolorUdpStatus
+  uint8_t position; // commands ahead of this one when it was queued
+};
+
+class DirectolorUdpClient
+{
+public:
+  DirectolorUdpClient() : fd(-1), sequence(0), resendCount(0)
+  {
+    struct timeval now;
+    gettimeofday(&now, 0);
+    sequence = now.tv_usec ^ getpid(); // a restarted client shouldn't look like a resend of the last run
+  }
+
+  ~DirectolorUdpClient() { close(); }
+
+  bool open(const char *host, uint16_t port = DIRECTOLOR_UDP_PORT)
+  {
+    close();
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints, *addresses;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, service, &hints, &addresses))
+      return false;
+    for (struct addrinfo *address = addresses; address && fd < 0; address = address->ai_next)
+    {
+      fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+      if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen)) // connected, so only the controller's datagrams come back
+        close();
+    }
+    freeaddrinfo(addresses);
+    return fd >= 0;
+  }
+
+  void close()
+  {
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+  }
+
+  // Queues up to DIRECTOLOR_UDP_MAX_COMMANDS commands.  Returns false if no ack came back after attempts tries - results (if given)
+  // then hold nothing useful.
+  bool send(const DirectolorUdpCommand *commands, uint8_t count, DirectolorUdpResult *results = 0, int timeoutMs = 50, int attempts = 4)
+  {
+    if (count > DIRECTOLOR_UDP_MAX_COMMANDS)
+      return false;
+    uint8_t request[DIRECTOLOR_UDP_MAX_REQUEST];
+    uint8_t length = directolorUdpWriteHeader(request, directolor_udpCommand, ++sequence, count);
+    for (uint8_t i = 0; i < count; i++)
+    {
+      request[length++] = commands[i].remote;
+      request[length++] = commands[i].channels;
+      request[length++] = commands[i].action;
+    }
+    return exchange(request, length, results, timeoutMs, attempts);
+  }
+
+  bool ping(int timeoutMs = 50, int attempts = 4)
+  {
+    uint8_t request[DIRECTOLOR_UDP_HEADER_SIZE];
+    uint8_t length = directolorUdpWriteHeader(request, directolor_udpPing, ++sequence, 0);
+    return exchange(request, length, 0, timeoutMs, attempts);
+  }
+
+  uint32_t resends() const { return resendCount; } // datagrams sent again because an ack didn't come back in time
+
+private:
+  int fd;
+  uint16_t sequence;
+  uint32_t resendCount;
+
+  bool exchange(const uint8_t *request, uint8_t length, DirectolorUdpResult *results, int timeoutMs, int attempts)
+  {
+    if (fd < 0)
+      return false;
+    for (int attempt = 0; attempt < attempts; attempt++)
+    {
+      if (attempt)
+        resendCount++;
+      if (::send(fd, request, length, 0) != length)
+        continue;
+
+      struct timespec start;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      int remaining = timeoutMs;
+      while (remaining > 0)
+      {
+        struct pollfd waitFor = {fd, POLLIN, 0};
+        if (poll(&waitFor, 1, remaining) <= 0)
+          break;
+
+        uint8_t ack[DIRECTOLOR_UDP_MAX_ACK + 1];
+        ssize_t received = recv(fd, ack, sizeof(ack), 0);
+        DirectolorUdpHeader header;
+        if (received > 0 && directolorUdpParseHeader(ack, received, header) && header.type == directolor_udpAck && header.sequence == sequence)
+        {
+          for (uint8_t i = 0; results && i < header.count; i++)
+          {
+            results[i].status = ack[DIRECTOLOR_UDP_HEADER_SIZE + i * DIRECTOLOR_UDP_ACK_ITEM_SIZE];
+            results[i].position = ack[DIRECTOLOR_UDP_HEADER_SIZE + i * DIRECTOLOR_UDP_ACK_ITEM_SIZE + 1];
+          }
+          return true;
+        }
+
+        struct timespec now; // a late ack for an earlier datagram - keep waiting for ours
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        remaining = timeoutMs - (int)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+      }
+    }
+    return false;
+  }
+};
+
+#endif
@@ -0,0 +1,362 @@
+/*
+  Directolor- Arduino libary for Directolor Blinds using nrf24l01+
+  Copyright (c) 2022 Jason Loucks.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+*/
+
+/**
+   Round trip latency of the binary UDP protocol against the HTTP API, per command and per batch.
+
+   Build (Linux / macOS):
+     g++ -O2 -pthread -I../.. -I../../examples/Directolor UdpLatency.cpp -o UdpLatency
+
+   Usage:
+     UdpLatency [--count N] [--batch N]                  loopback - both paths are served on 127.0.0.1 by this program
+     UdpLatency --host directolor.local [--commands]     against a controller running the Directolor example
+
+   Loopback runs a UDP and an HTTP server in threads that answer with the web example's own code - directolorUdpReceive (as
+   ControlUdp does) and a ControlConnection per request (as ControlPlane does) - with commands counted rather than sent, so what's
+   left is the cost of the two protocols themselves - connection setup, request and reply size, parsing.  Three things are timed,
+   each for --batch shades:
+     udp         one datagram with every command, until its ack
+     http        one /api request per shade, one after another - what a hub driver sending a command per device does
+     http batch  one /api/batch request with every command
+
+   Against a controller nothing is sent to the shades unless --commands is given (then every command is a stop on remote 1) - without
+   it, udp is a ping and http is /api/status, which is the same round trip without touching the queue.
+*/
+
+#include "DirectolorUdpClient.h"
+#include "ControlConnection.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define LOOPBACK_REMOTES 7
+#define LOOPBACK_CHANNELS 6
+
+typedef std::chrono::steady_clock Clock;
+
+static int loopbackSocket(int type, uint16_t &port)
+{
+  int fd = socket(AF_INET, type, 0);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) || getsockname(fd, (struct sockaddr *)&address, &length))
+  {
+    perror("loopback socket");
+    exit(1);
+  }
+  port = ntohs(address.sin_port);
+  return fd;
+}
+
+// The loopback servers' side of the controller - one UDP client, and commands are only counted.
+struct Loopback
+{
+  DirectolorUdpPeer peer;
+  unsigned queued;
+};
+
+static DirectolorUdpPeer &loopbackPeer(void *, void *context)
+{
+  return ((Loopback *)context)->peer;
+}
+
+static bool loopbackUdpEnqueue(uint8_t, uint8_t, uint8_t, void *context)
+{
+  ((Loopback *)context)->queued++;
+  return true;
+}
+
+static unsigned loopbackWaiting(void *context)
+{
+  return ((Loopback *)context)->queued % 14; // nothing drains a loopback queue - just keep the ack positions plausible
+}
+
+static bool loopbackEnqueue(const ControlCommand &, void *context)
+{
+  ((Loopback *)context)->queued++;
+  return true;
+}
+
+static int loopbackStatus(char *body, size_t size, void *context)
+{
+  return snprintf(body, size, "{\"remotes\":%d,\"channels\":%d,\"pending\":%u,\"streams\":0,\"dropped\":0,\"radio\":\"up\"}", LOOPBACK_REMOTES, LOOPBACK_CHANNELS, loopbackWaiting(context));
+}
+
+static void serveUdp(int fd)
+{
+  static Loopback loopback;
+  DirectolorUdpService service = {LOOPBACK_REMOTES, LOOPBACK_CHANNELS, loopbackPeer, loopbackUdpEnqueue, loopbackWaiting, &loopback};
+  for (;;)
+  {
+    uint8_t request[DIRECTOLOR_UDP_MAX_REQUEST + 1];
+    struct sockaddr_storage from;
+    socklen_t fromLength = sizeof(from);
+    ssize_t length = recvfrom(fd, request, sizeof(request), 0, (struct sockaddr *)&from, &fromLength);
+    uint8_t reply[DIRECTOLOR_UDP_MAX_ACK];
+    uint8_t replyLength = length > 0 ? directolorUdpReceive(request, length, &from, service, reply) : 0;
+    if (replyLength)
+      sendto(fd, reply, replyLength, 0, (struct sockaddr *)&from, fromLength);
+  }
+}
+
+// ControlTransport on a blocking socket - add() writes straight to it, and what it took is acked after each receive().
+struct HttpClient
+{
+  int fd;
+  size_t written; // not acked to the connection yet
+  bool closing;
+};
+
+static size_t httpSpace(void *)
+{
+  return CONTROL_PLANE_RESPONSE_BUFFER;
+}
+
+static size_t httpAdd(void *client, const char *data, size_t length)
+{
+  HttpClient *http = (HttpClient *)client;
+  ssize_t written = send(http->fd, data, length, MSG_NOSIGNAL);
+  if (written <= 0)
+    return 0;
+  http->written += written;
+  return written;
+}
+
+static void httpSend(void *) {}
+
+static void httpClose(void *client)
+{
+  ((HttpClient *)client)->closing = true;
+}
+
+static const ControlTransport httpTransport = {httpSpace, httpAdd, httpSend, httpClose};
+
+// One request per connection, one connection at a time.
+static void serveHttp(int fd)
+{
+  static Loopback loopback;
+  ControlService service = {LOOPBACK_REMOTES, loopbackEnqueue, loopbackWaiting, loopbackStatus, &loopback};
+  static ControlConnection connection;
+  listen(fd, 16);
+  for (;;)
+  {
+    HttpClient client = {accept(fd, 0, 0), 0, false};
+    if (client.fd < 0)
+      continue;
+    int on = 1;
+    setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    connection.begin(&client, &httpTransport, &service);
+    while (!client.closing)
+    {
+      char data[512];
+      ssize_t received = recv(client.fd, data, sizeof(data), 0);
+      if (received <= 0)
+        break;
+      connection.receive(data, received);
+      while (client.written && !client.closing)
+      {
+        size_t written = client.written;
+        client.written = 0;
+        connection.acked(written);
+      }
+    }
+    connection.begin(0, &httpTransport, &service);
+    close(client.fd);
+  }
+}
+
+// One request on a fresh connection, read to the end.  Returns false unless the reply is a 200.
+static bool httpGet(const char *host, uint16_t port, const char *path)
+{
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo hints, *addresses;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, service, &hints, &addresses))
+    return false;
+  int fd = socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol);
+  bool connected = fd >= 0 && !connect(fd, addresses->ai_addr, addresses->ai_addrlen);
+  freeaddrinfo(addresses);
+  if (!connected)
+  {
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+  char request[512];
+  int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path, host);
+  send(fd, request, length, 0);
+
+  char reply[512];
+  int received = 0;
+  for (ssize_t chunk; (chunk = recv(fd, reply + received, sizeof(reply) - 1 - received, 0)) > 0 && received + chunk < (ssize_t)sizeof(reply) - 1;)
+    received += chunk;
+  reply[received] = 0;
+  close(fd);
+  return received > 12 && !memcmp(reply + 9, "200", 3);
+}
+
+struct Timing
+{
+  const char *name;
+  std::vector<double> micros;
+  int failures;
+};
+
+static void report(Timing &timing, int batch)
+{
+  if (timing.micros.empty())
+  {
+    printf("%-11s  no successful round trips (%d failed)\n", timing.name, timing.failures);
+    return;
+  }
+  std::sort(timing.micros.begin(), timing.micros.end());
+  double total = 0;
+  for (double micros : timing.micros)
+    total += micros;
+  size_t count = timing.micros.size();
+  printf("%-11s  min %9.1f  median %9.1f  p99 %9.1f  mean %9.1f us   per shade %8.1f us   failed %d\n", timing.name, timing.micros[0], timing.micros[count / 2], timing.micros[std::min(count - 1, count * 99 / 100)], total / count, timing.micros[count / 2] / batch, timing.failures);
+}
+
+template <typename Work>
+static void measure(Timing &timing, int count, Work work)
+{
+  for (int i = 0; i < count; i++)
+  {
+    Clock::time_point start = Clock::now();
+    bool ok = work();
+    double micros = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    if (ok)
+      timing.micros.push_back(micros);
+    else
+      timing.failures++;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *host = 0;
+  uint16_t udpPort = DIRECTOLOR_UDP_PORT;
+  uint16_t httpPort = 80;
+  int count = 1000;
+  int batch = 6;
+  bool commands = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--host") && i + 1 < argc)
+      host = argv[++i];
+    else if (!strcmp(argv[i], "--udp-port") && i + 1 < argc)
+      udpPort = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--http-port") && i + 1 < argc)
+      httpPort = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--count") && i + 1 < argc)
+      count = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--batch") && i + 1 < argc)
+      batch = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--commands"))
+      commands = true;
+    else
+    {
+      fprintf(stderr, "usage: %s [--host H [--commands]] [--udp-port P] [--http-port P] [--count N] [--batch N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (count < 1 || batch < 1 || batch > DIRECTOLOR_UDP_MAX_COMMANDS)
+  {
+    fprintf(stderr, "--count must be at least 1 and --batch 1 - %d\n", DIRECTOLOR_UDP_MAX_COMMANDS);
+    return 2;
+  }
+
+  if (!host)
+  {
+    host = "127.0.0.1";
+    commands = true;
+    int udpServer = loopbackSocket(SOCK_DGRAM, udpPort);
+    int httpServer = loopbackSocket(SOCK_STREAM, httpPort);
+    std::thread(serveUdp, udpServer).detach();
+    std::thread(serveHttp, httpServer).detach();
+  }
+
+  DirectolorUdpClient client;
+  if (!client.open(host, udpPort))
+  {
+    fprintf(stderr, "can't resolve %s\n", host);
+    return 1;
+  }
+
+  DirectolorUdpCommand udpCommands[DIRECTOLOR_UDP_MAX_COMMANDS];
+  DirectolorUdpResult results[DIRECTOLOR_UDP_MAX_COMMANDS];
+  char batchPath[32 + DIRECTOLOR_UDP_MAX_COMMANDS * 8] = "/api/batch?cmds=";
+  for (int i = 0; i < batch; i++)
+  {
+    udpCommands[i].remote = 1;
+    udpCommands[i].channels = 1 << (i % LOOPBACK_CHANNELS);
+    udpCommands[i].action = directolor_stop;
+    snprintf(batchPath + strlen(batchPath), sizeof(batchPath) - strlen(batchPath), "%s1.%d.stop", i ? "," : "", i % LOOPBACK_CHANNELS + 1);
+  }
+
+  printf("%s - %d round trips of %d shade(s)%s\n\n", host, count, batch, commands ? "" : " (ping / status only - see --commands)");
+
+  Timing udp = {"udp", {}, 0};
+  measure(udp, count, [&]() {
+    if (!commands)
+      return client.ping(250);
+    if (!client.send(udpCommands, batch, results, 250))
+      return false;
+    for (int i = 0; i < batch; i++)
+      if (results[i].status != directolor_udpQueued)
+        return false;
+    return true;
+  });
+
+  Timing http = {"http", {}, 0};
+  measure(http, count, [&]() {
+    for (int i = 0; i < (commands ? batch : 1); i++)
+    {
+      char path[64];
+      snprintf(path, sizeof(path), "/api?remote=1&channels=%u&action=stop", udpCommands[i].channels);
+      if (!httpGet(host, httpPort, commands ? path : "/api/status"))
+        return false;
+    }
+    return true;
+  });
+
+  Timing httpBatch = {"http batch", {}, 0};
+  measure(httpBatch, count, [&]() { return httpGet(host, httpPort, commands ? batchPath : "/api/status"); });
+
+  report(udp, batch);
+  report(http, batch);
+  report(httpBatch, batch);
+  if (client.resends())
+    printf("\n%u udp datagram(s) resent\n", client.resends());
+  return 0;
+}